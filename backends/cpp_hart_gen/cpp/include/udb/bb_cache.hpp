@@ -1,81 +1,256 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "udb/code_page_tracker.hpp"
+#include "udb/defines.hpp"
+#include "udb/timing_model.hpp"
+
 namespace udb {
   class InstBase;
 
+  // A decoded run of instructions, ending at a control-flow instruction, at
+  // MAX_BASIC_BLOCK_SIZE instructions, or at the end of the page it starts in.
+  //
+  // Blocks are tagged with the physical address of their first instruction and the
+  // decode context they were built under (see BasicBlockCache), so one block serves
+  // every virtual mapping of its code. The instructions themselves live in the cache's
+  // arena.
   template <unsigned SizeOfInst>
   class BasicBlock {
    public:
     static constexpr const unsigned MAX_BASIC_BLOCK_SIZE = 40;
+    static_assert(MAX_BASIC_BLOCK_SIZE <= 64, "m_pc_free has a bit per instruction");
 
-    using InstStorage = std::array<uint8_t, SizeOfInst>;
+    struct alignas(std::max_align_t) InstStorage {
+      uint8_t bytes[SizeOfInst];
+    };
 
     BasicBlock()
-        : m_size(0), m_head(0), m_start_pc(~static_cast<uint64_t>(0)) {}
+        : m_size(0), m_head(0), m_start_pc(~static_cast<uint64_t>(0)),
+          m_start_paddr(~static_cast<uint64_t>(0)), m_decode_ctx(0), m_cost(0), m_pc_free(0),
+          m_insts(nullptr), m_segment(0) {}
 
-    void recycle(uint64_t start_pc) {
+    // start an empty block whose instructions go to 'storage', which has room for
+    // MAX_BASIC_BLOCK_SIZE instructions (see BasicBlockCache::begin_block)
+    void recycle(uint64_t start_pc, uint64_t start_paddr, uint64_t decode_ctx, InstStorage* storage,
+                 unsigned segment) {
       m_start_pc = start_pc;
+      m_start_paddr = start_paddr;
+      m_decode_ctx = decode_ctx;
+      m_insts = storage;
+      m_segment = segment;
       m_size = 0;
       m_head = 0;
+      m_cost = 0;
+      m_pc_free = 0;
+      m_class_counts.fill(0);
+      m_pages.clear();
     }
 
+    // virtual address the block was built at. The block runs at any address that
+    // maps to start_paddr().
     uint64_t start_pc() const { return m_start_pc; }
+    uint64_t start_paddr() const { return m_start_paddr; }
+    bool valid() const { return m_start_pc != ~static_cast<uint64_t>(0); }
+
+    // true if this is the block starting at physical address paddr under decode_ctx
+    bool matches(uint64_t paddr, uint64_t decode_ctx) const {
+      return m_start_paddr == paddr && m_decode_ctx == decode_ctx && valid();
+    }
+
+    // physical pages the block's instructions were fetched from
+    CodePages& code_pages() { return m_pages; }
+    const CodePages& code_pages() const { return m_pages; }
     unsigned size() const { return m_size; }
+
+    // modeled cost of running the whole block (see TimingModel)
+    uint64_t cost() const { return m_cost; }
+    void add_cost(uint64_t cost) { m_cost += cost; }
+
+    // number of instructions of each class in the block (see HpmCounters)
+    using ClassCounts = std::array<uint8_t, TimingModel::NUM_CLASSES>;
+    const ClassCounts& class_counts() const { return m_class_counts; }
+    void add_class(InstClass c) { m_class_counts[static_cast<unsigned>(c)]++; }
+
+    // instructions that neither read nor set the pc (see InstBase::uses_pc)
+    void mark_pc_free(unsigned i) { m_pc_free |= uint64_t{1} << i; }
+    bool pc_free(unsigned i) const { return (m_pc_free & (uint64_t{1} << i)) != 0; }
+
     void reset() { m_head = 0; }
-    void invalidate() { m_start_pc = ~static_cast<uint64_t>(0); }
+    // drop the block, and let go of its code pages
+    void invalidate() {
+      m_start_pc = ~static_cast<uint64_t>(0);
+      m_start_paddr = ~static_cast<uint64_t>(0);
+      m_pages.clear();
+    }
 
     bool full() const { return m_size == MAX_BASIC_BLOCK_SIZE; }
 
     InstBase* alloc_inst() {
-      InstBase* inst = reinterpret_cast<InstBase*>(m_insts[m_size].data());
+      InstBase* inst = reinterpret_cast<InstBase*>(m_insts[m_size].bytes);
       m_size++;
       return inst;
     }
 
+    // return the i'th instruction
+    InstBase* inst(unsigned i) {
+      return reinterpret_cast<InstBase*>(m_insts[i].bytes);
+    }
+
     // return the next instruction
     // does *not* check that the bb has another instruction
     InstBase* pop() {
-      return reinterpret_cast<InstBase*>(m_insts[m_head++].data());
+      return reinterpret_cast<InstBase*>(m_insts[m_head++].bytes);
     }
 
+    const InstStorage* storage() const { return m_insts; }
+
+    // arena segment holding the instructions
+    unsigned segment() const { return m_segment; }
+
    private:
     unsigned m_size;
     unsigned m_head;
     uint64_t m_start_pc;
-    std::array<InstStorage, MAX_BASIC_BLOCK_SIZE> m_insts;
+    uint64_t m_start_paddr;
+    uint64_t m_decode_ctx;
+    uint64_t m_cost;
+    uint64_t m_pc_free;
+    ClassCounts m_class_counts{};
+    CodePages m_pages;
+    InstStorage* m_insts;
+    unsigned m_segment;
   };
 
+  // Direct-mapped cache of basic blocks, indexed by the physical address of the
+  // block's first instruction. Changing satp doesn't invalidate anything, and code
+  // mapped into several address spaces is decoded once.
+  //
+  // Instructions are kept in an arena, bump-allocated and sized to each block's actual
+  // length. The arena is split into NUM_SEGMENTS segments used in turn. When the current
+  // segment is full, allocation moves to the next one, and every block still stored
+  // there is dropped at once; the oldest blocks are the first to go.
   template <unsigned SizeOfInst>
   class BasicBlockCache {
-    static const constexpr unsigned NUM_BASIC_BLOCKS = 2048;
-    static_assert(__builtin_popcount(NUM_BASIC_BLOCKS) == 1,
-                  "NUM_BASIC_BLOCKS must be a power of two");
-
    public:
     using BasicBlockType = BasicBlock<SizeOfInst>;
+    using InstStorage = typename BasicBlockType::InstStorage;
     static constexpr unsigned MAX_BASIC_BLOCK_SIZE =
         BasicBlockType::MAX_BASIC_BLOCK_SIZE;
+    static constexpr unsigned DEFAULT_NUM_BASIC_BLOCKS = 8192;
+
+    // arena space per block, in instructions; typical blocks are much shorter than the maximum
+    static constexpr unsigned ARENA_INSTS_PER_BLOCK = 8;
+    static constexpr unsigned NUM_SEGMENTS = 4;
 
-    BasicBlockCache() {}
+    BasicBlockCache() : m_num_bbs(DEFAULT_NUM_BASIC_BLOCKS) {}
 
-    BasicBlock<SizeOfInst>* get(uint64_t pc) {
-      unsigned idx = hash(pc);
+    // change the number of blocks in the cache. Must be a power of two.
+    // Any cached blocks are discarded.
+    void resize(unsigned num_bbs) {
+      udb_assert((num_bbs != 0) && (__builtin_popcount(num_bbs) == 1),
+                 "Number of basic blocks must be a power of two");
+      m_num_bbs = num_bbs;
+      m_bbs.reset();
+      m_arena.reset();
+    }
+
+    // instructions in one arena segment; always room for a block of the maximum size
+    unsigned segment_insts() const {
+      return std::max(m_num_bbs * ARENA_INSTS_PER_BLOCK / NUM_SEGMENTS, MAX_BASIC_BLOCK_SIZE);
+    }
+
+    unsigned num_blocks() const { return m_num_bbs; }
+
+    // the slot for the block starting at physical address paddr; the caller checks
+    // BasicBlock::matches for a hit
+    BasicBlock<SizeOfInst>* get(uint64_t paddr) {
+      // storage is allocated on first use so that harts that never run
+      // basic blocks don't pay for it
+      if (!m_bbs) [[unlikely]] {
+        m_bbs = std::make_unique<BasicBlockType[]>(m_num_bbs);
+        m_arena = std::make_unique<InstStorage[]>(NUM_SEGMENTS * segment_insts());
+        reset_arena();
+      }
+      unsigned idx = hash(paddr);
       return &m_bbs[idx];
     }
 
+    // Start building block 'bb' (a slot returned by get) in the arena. The storage of the
+    // block begun before it is kept for as many instructions as that block ended up with.
+    void begin_block(BasicBlockType* bb, uint64_t start_pc, uint64_t start_paddr, uint64_t decode_ctx) {
+      if (m_building != nullptr && m_building != bb) {
+        m_top += m_building->size();
+      }
+      if (m_building != bb && m_top + MAX_BASIC_BLOCK_SIZE > segment_insts()) {
+        next_segment();
+      }
+      m_building = bb;
+      bb->recycle(start_pc, start_paddr, decode_ctx, &m_arena[m_segment * segment_insts() + m_top], m_segment);
+    }
+
     void invalidate() {
-      for (unsigned i = 0; i < NUM_BASIC_BLOCKS; i++) {
+      if (!m_bbs) {
+        return;
+      }
+      for (unsigned i = 0; i < m_num_bbs; i++) {
         m_bbs[i].invalidate();
       }
+      reset_arena();
+    }
+
+    // invalidate every block fetched from physical page ppn
+    void invalidate_page(uint64_t ppn) {
+      if (!m_bbs) {
+        return;
+      }
+      for (unsigned i = 0; i < m_num_bbs; i++) {
+        if (m_bbs[i].valid() && m_bbs[i].code_pages().contains(ppn)) {
+          m_bbs[i].invalidate();
+        }
+      }
+    }
+
+    // bytes of host memory currently held by the cache
+    size_t memory_footprint() const {
+      return m_bbs ? (m_num_bbs * sizeof(BasicBlockType)) + (NUM_SEGMENTS * segment_insts() * sizeof(InstStorage))
+                   : 0;
     }
 
    private:
-    unsigned hash(uint64_t pc) {
-      // return number between [0..NUM_BASIC_BLOCKS)
-      return (pc >> 2) & (NUM_BASIC_BLOCKS - 1);
+    unsigned hash(uint64_t paddr) {
+      // return number between [0..m_num_bbs)
+      return (paddr >> 2) & (m_num_bbs - 1);
+    }
+
+    void reset_arena() {
+      m_segment = 0;
+      m_top = 0;
+      m_building = nullptr;
+    }
+
+    // move to the next segment, dropping the blocks stored there
+    void next_segment() {
+      m_segment = (m_segment + 1) % NUM_SEGMENTS;
+      m_top = 0;
+      for (unsigned i = 0; i < m_num_bbs; i++) {
+        if (m_bbs[i].valid() && m_bbs[i].segment() == m_segment) {
+          m_bbs[i].invalidate();
+        }
+      }
     }
 
    private:
-    std::array<BasicBlockType, NUM_BASIC_BLOCKS> m_bbs;
+    unsigned m_num_bbs;
+    std::unique_ptr<BasicBlockType[]> m_bbs;
+    std::unique_ptr<InstStorage[]> m_arena;
+    unsigned m_segment;             // segment being allocated from
+    unsigned m_top;                 // first free instruction slot in m_segment
+    BasicBlockType* m_building;     // block begun last; its size isn't counted in m_top yet
   };
 }  // namespace udb
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "udb/defines.hpp"
+#include "udb/shared_bb_cache.hpp"
+#include "udb/spsc_queue.hpp"
+
+namespace udb {
+
+  // Background worker that decodes candidate blocks and publishes them to a
+  // SharedBlockCache, so that the first execution of a block can hit in the
+  // cache instead of fetching and decoding inline.
+  //
+  // Each running hart is a producer with its own SPSC queue. Candidates that
+  // don't fit in a queue are dropped. The worker thread drains the queues and
+  // calls the translate function. That function must not touch any running
+  // hart; the ISS passes one backed by a private, never-run decoder hart.
+  //
+  // The worker never reads guest memory, which running harts write without
+  // synchronization. A hart submits a copy of the code, taken on its own thread,
+  // along with the candidate.
+  class BackgroundTranslator {
+   public:
+    struct Candidate {
+      static constexpr unsigned CODE_BYTES = SharedBlockRecord::MAX_INSTS * 4;
+
+      uint64_t pc;
+      uint64_t ctx;
+      uint64_t paddr;      // physical address of pc
+      uint64_t generation; // shared cache generation(paddr), read before the code was copied
+      unsigned num_bytes;  // bytes of code copied, at most up to the end of paddr's page
+      std::array<uint8_t, CODE_BYTES> code;  // copy of the memory at paddr
+    };
+
+    // decode the block in c into rec. Returns false if the block can't be
+    // translated off-line (e.g., the context doesn't match the decoder)
+    using TranslateFn = std::function<bool(const Candidate& c, SharedBlockRecord& rec)>;
+
+    struct Stats {
+      uint64_t submitted;
+      uint64_t dropped;     // queue was full
+      uint64_t translated;  // published to the shared cache
+      uint64_t skipped;     // already cached, or couldn't be translated
+    };
+
+    static constexpr size_t QUEUE_SIZE = 256;
+
+    BackgroundTranslator(std::shared_ptr<SharedBlockCache> cache, TranslateFn translate)
+      : m_cache(std::move(cache)),
+        m_translate(std::move(translate)),
+        m_running(false)
+    {}
+
+    BackgroundTranslator(const BackgroundTranslator&) = delete;
+    BackgroundTranslator& operator=(const BackgroundTranslator&) = delete;
+
+    ~BackgroundTranslator() { stop(); }
+
+    SharedBlockCache& cache() { return *m_cache; }
+
+    // returns an id to pass to submit(). Must be called before start().
+    unsigned register_producer() {
+      udb_assert(!m_running, "Producers must be registered before the worker starts");
+      m_queues.emplace_back(std::make_unique<SpscQueue<Candidate, QUEUE_SIZE>>());
+      return m_queues.size() - 1;
+    }
+
+    void start() {
+      udb_assert(!m_running, "Background translator already started");
+      m_cache_reader = m_cache->register_reader();
+      m_running = true;
+      m_worker = std::thread([this]() { run(); });
+    }
+
+    void stop() {
+      if (m_running.exchange(false)) {
+        m_worker.join();
+      }
+    }
+
+    // called by the hart; never blocks
+    void submit(unsigned producer, const Candidate& c) {
+      if (m_queues[producer]->push(c)) {
+        m_submitted.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+
+    Stats stats() const {
+      return {
+        m_submitted.load(std::memory_order_relaxed),
+        m_dropped.load(std::memory_order_relaxed),
+        m_translated.load(std::memory_order_relaxed),
+        m_skipped.load(std::memory_order_relaxed)
+      };
+    }
+
+   private:
+    void run() {
+      unsigned idle_polls = 0;
+      SharedBlockRecord rec;
+      while (m_running.load(std::memory_order_relaxed)) {
+        bool did_work = false;
+        for (auto& q : m_queues) {
+          while (auto c = q->pop()) {
+            did_work = true;
+            process(*c, rec);
+          }
+        }
+
+        if (did_work) {
+          idle_polls = 0;
+        } else if (++idle_polls > 64) {
+          // nothing to do; back off rather than spinning
+          std::this_thread::sleep_for(std::chrono::microseconds(50));
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    }
+
+    void process(const Candidate& c, SharedBlockRecord& rec) {
+      bool cached;
+      {
+        SharedBlockCache::ReadGuard guard(*m_cache, m_cache_reader);
+        cached = m_cache->lookup(c.pc, c.ctx) != nullptr;
+      }
+      if (cached || !m_translate(c, rec)) {
+        m_skipped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      if (!m_cache->publish(rec, c.generation)) {
+        // the code was written after it was copied
+        m_skipped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      m_translated.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::shared_ptr<SharedBlockCache> m_cache;
+    TranslateFn m_translate;
+    unsigned m_cache_reader = 0;
+
+    std::vector<std::unique_ptr<SpscQueue<Candidate, QUEUE_SIZE>>> m_queues;
+    std::atomic<bool> m_running;
+    std::thread m_worker;
+
+    std::atomic<uint64_t> m_submitted{0};
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_translated{0};
+    std::atomic<uint64_t> m_skipped{0};
+  };
+
+}  // namespace udb
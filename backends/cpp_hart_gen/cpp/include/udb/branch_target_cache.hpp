@@ -0,0 +1,160 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace udb {
+
+  // Jump instructions that end a block, as far as finding the next block goes
+  enum class JumpKind : uint8_t {
+    None,    // not a jump
+    Jal,     // jal; rd in bits 11:7
+    Jalr,    // jalr; rd in bits 11:7, rs1 in bits 19:15
+    CJ,      // c.j
+    CJal,    // c.jal; rd is x1
+    CJr,     // c.jr; rs1 in bits 11:7
+    CJalr,   // c.jalr; rd is x1, rs1 in bits 11:7
+    CmJt,    // cm.jt; through the jump table
+    CmJalt   // cm.jalt; through the jump table, rd is x1
+  };
+
+  // true if the target of a jump of kind 'kind' isn't fixed by its encoding
+  constexpr bool jump_is_indirect(JumpKind kind) {
+    return kind == JumpKind::Jalr || kind == JumpKind::CJr || kind == JumpKind::CJalr ||
+           kind == JumpKind::CmJt || kind == JumpKind::CmJalt;
+  }
+
+  // What a jump does to the return-address stack, from the hints in the unprivileged
+  // spec: x1 and x5 are link registers; writing one is a call, and reading one (but
+  // not writing the same one) is a return.
+  enum class RasAction : uint8_t { None, Push, Pop, PopThenPush };
+
+  constexpr RasAction ras_action(JumpKind kind, uint64_t encoding) {
+    auto is_link = [](unsigned r) { return r == 1 || r == 5; };
+    const unsigned bits_11_7 = (encoding >> 7) & 0x1f;
+    unsigned rd = 0, rs1 = 0;
+    switch (kind) {
+      case JumpKind::Jal:
+        rd = bits_11_7;
+        break;
+      case JumpKind::Jalr:
+        rd = bits_11_7;
+        rs1 = (encoding >> 15) & 0x1f;
+        break;
+      case JumpKind::CJal:
+      case JumpKind::CmJalt:
+        rd = 1;
+        break;
+      case JumpKind::CJr:
+        rs1 = bits_11_7;
+        break;
+      case JumpKind::CJalr:
+        rd = 1;
+        rs1 = bits_11_7;
+        break;
+      default:
+        return RasAction::None;
+    }
+    if (is_link(rd)) {
+      return (is_link(rs1) && rs1 != rd) ? RasAction::PopThenPush : RasAction::Push;
+    }
+    return is_link(rs1) ? RasAction::Pop : RasAction::None;
+  }
+
+  // Where a jump went: the block at virtual address pc starts at physical address paddr.
+  //
+  // That only holds while the mapping of pc is unchanged, so a target is tagged with the
+  // privilege mode and translation epoch it was found under. The hart moves to a new
+  // epoch whenever a CSR that translation depends on is written or a fence drops soft
+  // TLB entries.
+  struct BranchTarget {
+    uint64_t pc;
+    uint64_t paddr;
+    uint64_t epoch;
+    uint8_t mode;
+    bool valid;
+
+    bool matches(uint64_t _pc, uint64_t _epoch, uint8_t _mode) const {
+      return valid && pc == _pc && epoch == _epoch && mode == _mode;
+    }
+  };
+
+  // Targets of recent indirect jumps, tagged by the block the jump ended (any pointer
+  // that identifies it) and the target pc. Direct-mapped.
+  class IndirectTargetCache {
+   public:
+    static constexpr unsigned NUM_ENTRIES = 256;
+
+    IndirectTargetCache() { invalidate(); }
+
+    const BranchTarget* lookup(const void* src, uint64_t pc, uint64_t epoch, uint8_t mode) const {
+      const Entry& e = m_entries[slot(src, pc)];
+      return (e.src == src && e.target.matches(pc, epoch, mode)) ? &e.target : nullptr;
+    }
+
+    void fill(const void* src, const BranchTarget& target) {
+      m_entries[slot(src, target.pc)] = {src, target};
+    }
+
+    void invalidate() {
+      for (Entry& e : m_entries) {
+        e.src = nullptr;
+        e.target.valid = false;
+      }
+    }
+
+   private:
+    struct Entry {
+      const void* src;
+      BranchTarget target;
+    };
+
+    static unsigned slot(const void* src, uint64_t pc) {
+      const uint64_t s = reinterpret_cast<uintptr_t>(src);
+      return ((s >> 4) ^ (s >> 12) ^ (pc >> 1)) & (NUM_ENTRIES - 1);
+    }
+
+    std::array<Entry, NUM_ENTRIES> m_entries;
+  };
+
+  // Shadow return-address stack. Calls push the return address, and returns pop it.
+  // When the stack is full, a push drops the oldest entry; popping an empty stack
+  // gives an invalid target.
+  class ReturnAddressStack {
+   public:
+    static constexpr unsigned DEPTH = 16;
+
+    ReturnAddressStack() { clear(); }
+
+    void push(const BranchTarget& target) {
+      m_top = (m_top + 1) % DEPTH;
+      m_entries[m_top] = target;
+      if (m_size < DEPTH) {
+        m_size++;
+      }
+    }
+
+    BranchTarget pop() {
+      if (m_size == 0) {
+        return BranchTarget{};
+      }
+      const BranchTarget target = m_entries[m_top];
+      m_top = (m_top + DEPTH - 1) % DEPTH;
+      m_size--;
+      return target;
+    }
+
+    void clear() {
+      m_top = 0;
+      m_size = 0;
+    }
+
+    unsigned size() const { return m_size; }
+
+   private:
+    unsigned m_top;
+    unsigned m_size;
+    std::array<BranchTarget, DEPTH> m_entries{};
+  };
+
+}  // namespace udb
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace udb {
+
+  class CodePageTracker;
+
+  // Physical pages that a cached basic block was fetched from.
+  // If a block touches more pages than fit, it is treated as being on every page.
+  //
+  // Pages recorded with a tracker are held in its filter until the block is cleared.
+  // Pages past MAX_PAGES are held but not remembered, so they are never released.
+  struct CodePages {
+    static constexpr unsigned MAX_PAGES = 4;
+
+    // forget the pages, and release them in the tracker
+    inline void clear();
+
+    // returns true if ppn is new to the block (the caller then marks it in the tracker)
+    bool add(uint64_t ppn) {
+      for (unsigned i = 0; i < num; i++) {
+        if (ppns[i] == ppn) {
+          return false;
+        }
+      }
+      if (num == MAX_PAGES) {
+        overflow = true;
+      } else {
+        ppns[num++] = ppn;
+      }
+      return true;
+    }
+
+    bool contains(uint64_t ppn) const {
+      if (overflow) {
+        return true;
+      }
+      for (unsigned i = 0; i < num; i++) {
+        if (ppns[i] == ppn) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    std::array<uint64_t, MAX_PAGES> ppns;
+    unsigned num = 0;
+    bool overflow = false;
+    CodePageTracker* tracker = nullptr;  // where ppns are held, if anywhere
+  };
+
+  // Detects stores to memory that holds cached code, shared by all harts of a system.
+  //
+  // Harts mark each physical page a block is fetched from while building it, and
+  // release the page when the block is dropped. The store path tests a page filter:
+  // a count of the blocks held on each bucket of hashed page numbers, so false
+  // positives are possible but not false negatives, and a page stops hitting once no
+  // cached block remains on its bucket. A store that hits the filter is appended to a
+  // small ring of written pages, without locking. Each hart drains the ring and
+  // invalidates only its blocks on those pages. A hart that falls more than a ring's
+  // worth behind (or races with a write in progress) must flush its whole cache.
+  class CodePageTracker {
+   public:
+    static constexpr unsigned PAGE_SHIFT = 12;
+    static constexpr unsigned FILTER_SIZE = 1 << 14;
+    static constexpr unsigned RING_SIZE = 64;
+
+    CodePageTracker() : m_seq(0) {
+      for (auto& r : m_refs) {
+        r.store(0, std::memory_order_relaxed);
+      }
+      for (auto& e : m_ring) {
+        e.seq.store(0, std::memory_order_relaxed);
+        e.ppn.store(0, std::memory_order_relaxed);
+      }
+    }
+
+    CodePageTracker(const CodePageTracker&) = delete;
+    CodePageTracker& operator=(const CodePageTracker&) = delete;
+
+    static uint64_t ppn(uint64_t paddr) { return paddr >> PAGE_SHIFT; }
+
+    // a block now holds code from paddr's page
+    void mark_code(uint64_t paddr) {
+      m_refs[filter_index(ppn(paddr))].fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    // a block holding code from page ppn was dropped
+    void release_code(uint64_t ppn) {
+      m_refs[filter_index(ppn)].fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    // store fast path: could paddr be on a code page?
+    bool maybe_code(uint64_t paddr) const {
+      return m_refs[filter_index(ppn(paddr))].load(std::memory_order_relaxed) != 0;
+    }
+
+    // record a store to a (possible) code page
+    void note_write(uint64_t paddr) {
+      const uint64_t seq = m_seq.fetch_add(1, std::memory_order_relaxed);
+      RingEntry& e = m_ring[seq % RING_SIZE];
+      e.seq.store(0, std::memory_order_relaxed);  // being written
+      std::atomic_thread_fence(std::memory_order_release);
+      e.ppn.store(ppn(paddr), std::memory_order_relaxed);
+      e.seq.store(seq + 1, std::memory_order_release);
+    }
+
+    // number of writes recorded so far
+    uint64_t sequence() const { return m_seq.load(std::memory_order_acquire); }
+
+    // call fn(ppn) for every page written since seen, and advance seen.
+    // Returns false if some writes were lost (the caller must flush everything).
+    template <typename Fn>
+    bool drain(uint64_t& seen, Fn&& fn) const {
+      const uint64_t end = m_seq.load(std::memory_order_acquire);
+      if (end - seen > RING_SIZE) {
+        seen = end;
+        return false;
+      }
+      for (uint64_t s = seen; s < end; s++) {
+        // each entry is tagged with its sequence number plus one; anything else means it
+        // was overwritten, or is still being written
+        const RingEntry& e = m_ring[s % RING_SIZE];
+        if (e.seq.load(std::memory_order_acquire) != s + 1) {
+          seen = end;
+          return false;
+        }
+        const uint64_t page = e.ppn.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (e.seq.load(std::memory_order_relaxed) != s + 1) {
+          seen = end;
+          return false;
+        }
+        fn(page);
+      }
+      seen = end;
+      return true;
+    }
+
+   private:
+    struct RingEntry {
+      std::atomic<uint64_t> seq;
+      std::atomic<uint64_t> ppn;
+    };
+
+    static unsigned filter_index(uint64_t ppn) {
+      return (ppn ^ (ppn >> 14) ^ (ppn >> 28) ^ (ppn >> 42)) & (FILTER_SIZE - 1);
+    }
+
+    std::array<std::atomic<uint32_t>, FILTER_SIZE> m_refs;
+
+    std::atomic<uint64_t> m_seq;
+    std::array<RingEntry, RING_SIZE> m_ring;
+  };
+
+  void CodePages::clear() {
+    if (tracker != nullptr) {
+      for (unsigned i = 0; i < num; i++) {
+        tracker->release_code(ppns[i]);
+      }
+      tracker = nullptr;
+    }
+    num = 0;
+    overflow = false;
+  }
+
+}  // namespace udb
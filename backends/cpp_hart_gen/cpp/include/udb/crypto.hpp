@@ -0,0 +1,477 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define UDB_CRYPTO_X86 1
+#include <immintrin.h>
+#else
+#define UDB_CRYPTO_X86 0
+#endif
+
+// Primitives behind the scalar and vector cryptography instructions (see spec/std/isa/isa/crypto.idl).
+//
+// Everything has a portable, table-based implementation. On x86-64 hosts, AES, SHA-256
+// and carry-less multiply use AES-NI, SHA-NI and PCLMULQDQ when the host CPU has them;
+// that is checked once at run time, so the simulator doesn't need to be built for the host.
+
+namespace udb {
+  namespace crypto {
+
+    namespace detail {
+      // multiply in GF(2^8) modulo the AES polynomial x^8 + x^4 + x^3 + x + 1
+      constexpr uint8_t gf_mul(uint8_t a, uint8_t b) {
+        uint8_t p = 0;
+        for (unsigned i = 0; i < 8; i++) {
+          if (b & 1) {
+            p ^= a;
+          }
+          const bool hi = (a & 0x80) != 0;
+          a <<= 1;
+          if (hi) {
+            a ^= 0x1b;
+          }
+          b >>= 1;
+        }
+        return p;
+      }
+
+      constexpr std::array<uint8_t, 256> make_aes_sbox() {
+        std::array<uint8_t, 256> sbox{};
+        for (unsigned x = 0; x < 256; x++) {
+          uint8_t inv = 0;
+          for (unsigned y = 1; y < 256 && x != 0; y++) {
+            if (gf_mul(x, y) == 1) {
+              inv = y;
+              break;
+            }
+          }
+          const uint8_t s = inv ^ std::rotl(inv, 1) ^ std::rotl(inv, 2) ^ std::rotl(inv, 3) ^ std::rotl(inv, 4) ^ 0x63;
+          sbox[x] = s;
+        }
+        return sbox;
+      }
+
+      constexpr std::array<uint8_t, 256> make_inverse(const std::array<uint8_t, 256>& sbox) {
+        std::array<uint8_t, 256> inv{};
+        for (unsigned x = 0; x < 256; x++) {
+          inv[sbox[x]] = x;
+        }
+        return inv;
+      }
+
+      inline constexpr std::array<uint8_t, 256> AES_SBOX = make_aes_sbox();
+      inline constexpr std::array<uint8_t, 256> AES_INV_SBOX = make_inverse(AES_SBOX);
+
+      inline constexpr std::array<uint8_t, 256> SM4_SBOX = {
+        0xd6, 0x90, 0xe9, 0xfe, 0xcc, 0xe1, 0x3d, 0xb7, 0x16, 0xb6, 0x14, 0xc2, 0x28, 0xfb, 0x2c, 0x05,
+        0x2b, 0x67, 0x9a, 0x76, 0x2a, 0xbe, 0x04, 0xc3, 0xaa, 0x44, 0x13, 0x26, 0x49, 0x86, 0x06, 0x99,
+        0x9c, 0x42, 0x50, 0xf4, 0x91, 0xef, 0x98, 0x7a, 0x33, 0x54, 0x0b, 0x43, 0xed, 0xcf, 0xac, 0x62,
+        0xe4, 0xb3, 0x1c, 0xa9, 0xc9, 0x08, 0xe8, 0x95, 0x80, 0xdf, 0x94, 0xfa, 0x75, 0x8f, 0x3f, 0xa6,
+        0x47, 0x07, 0xa7, 0xfc, 0xf3, 0x73, 0x17, 0xba, 0x83, 0x59, 0x3c, 0x19, 0xe6, 0x85, 0x4f, 0xa8,
+        0x68, 0x6b, 0x81, 0xb2, 0x71, 0x64, 0xda, 0x8b, 0xf8, 0xeb, 0x0f, 0x4b, 0x70, 0x56, 0x9d, 0x35,
+        0x1e, 0x24, 0x0e, 0x5e, 0x63, 0x58, 0xd1, 0xa2, 0x25, 0x22, 0x7c, 0x3b, 0x01, 0x21, 0x78, 0x87,
+        0xd4, 0x00, 0x46, 0x57, 0x9f, 0xd3, 0x27, 0x52, 0x4c, 0x36, 0x02, 0xe7, 0xa0, 0xc4, 0xc8, 0x9e,
+        0xea, 0xbf, 0x8a, 0xd2, 0x40, 0xc7, 0x38, 0xb5, 0xa3, 0xf7, 0xf2, 0xce, 0xf9, 0x61, 0x15, 0xa1,
+        0xe0, 0xae, 0x5d, 0xa4, 0x9b, 0x34, 0x1a, 0x55, 0xad, 0x93, 0x32, 0x30, 0xf5, 0x8c, 0xb1, 0xe3,
+        0x1d, 0xf6, 0xe2, 0x2e, 0x82, 0x66, 0xca, 0x60, 0xc0, 0x29, 0x23, 0xab, 0x0d, 0x53, 0x4e, 0x6f,
+        0xd5, 0xdb, 0x37, 0x45, 0xde, 0xfd, 0x8e, 0x2f, 0x03, 0xff, 0x6a, 0x72, 0x6d, 0x6c, 0x5b, 0x51,
+        0x8d, 0x1b, 0xaf, 0x92, 0xbb, 0xdd, 0xbc, 0x7f, 0x11, 0xd9, 0x5c, 0x41, 0x1f, 0x10, 0x5a, 0xd8,
+        0x0a, 0xc1, 0x31, 0x88, 0xa5, 0xcd, 0x7b, 0xbd, 0x2d, 0x74, 0xd0, 0x12, 0xb8, 0xe5, 0xb4, 0xb0,
+        0x89, 0x69, 0x97, 0x4a, 0x0c, 0x96, 0x77, 0x7e, 0x65, 0xb9, 0xf1, 0x09, 0xc5, 0x6e, 0xc6, 0x84,
+        0x18, 0xf0, 0x7d, 0xec, 0x3a, 0xdc, 0x4d, 0x20, 0x79, 0xee, 0x5f, 0x3e, 0xd7, 0xcb, 0x39, 0x48
+      };
+
+      // byte i of the 128-bit AES state {hi, lo}; bytes are column-major (column i / 4, row i % 4)
+      constexpr uint8_t state_byte(uint64_t lo, uint64_t hi, unsigned i) {
+        return (i < 8) ? static_cast<uint8_t>(lo >> (8 * i)) : static_cast<uint8_t>(hi >> (8 * (i - 8)));
+      }
+
+      constexpr uint32_t mix_column(uint32_t col) {
+        const uint8_t a0 = col, a1 = col >> 8, a2 = col >> 16, a3 = col >> 24;
+        const uint8_t b0 = gf_mul(a0, 2) ^ gf_mul(a1, 3) ^ a2 ^ a3;
+        const uint8_t b1 = a0 ^ gf_mul(a1, 2) ^ gf_mul(a2, 3) ^ a3;
+        const uint8_t b2 = a0 ^ a1 ^ gf_mul(a2, 2) ^ gf_mul(a3, 3);
+        const uint8_t b3 = gf_mul(a0, 3) ^ a1 ^ a2 ^ gf_mul(a3, 2);
+        return b0 | (b1 << 8) | (b2 << 16) | (static_cast<uint32_t>(b3) << 24);
+      }
+
+      constexpr uint32_t inv_mix_column(uint32_t col) {
+        const uint8_t a0 = col, a1 = col >> 8, a2 = col >> 16, a3 = col >> 24;
+        const uint8_t b0 = gf_mul(a0, 14) ^ gf_mul(a1, 11) ^ gf_mul(a2, 13) ^ gf_mul(a3, 9);
+        const uint8_t b1 = gf_mul(a0, 9) ^ gf_mul(a1, 14) ^ gf_mul(a2, 11) ^ gf_mul(a3, 13);
+        const uint8_t b2 = gf_mul(a0, 13) ^ gf_mul(a1, 9) ^ gf_mul(a2, 14) ^ gf_mul(a3, 11);
+        const uint8_t b3 = gf_mul(a0, 11) ^ gf_mul(a1, 13) ^ gf_mul(a2, 9) ^ gf_mul(a3, 14);
+        return b0 | (b1 << 8) | (b2 << 16) | (static_cast<uint32_t>(b3) << 24);
+      }
+
+      constexpr uint32_t sub_word(uint32_t w) {
+        return AES_SBOX[w & 0xff] | (AES_SBOX[(w >> 8) & 0xff] << 8) |
+               (AES_SBOX[(w >> 16) & 0xff] << 16) | (static_cast<uint32_t>(AES_SBOX[w >> 24]) << 24);
+      }
+
+      // low half of (Inv)ShiftRows + (Inv)SubBytes of the state {hi, lo}
+      template <bool Inverse>
+      constexpr uint64_t aes64_sub_shift(uint64_t lo, uint64_t hi) {
+        uint64_t result = 0;
+        for (unsigned i = 0; i < 8; i++) {
+          const unsigned row = i % 4;
+          const unsigned col = i / 4;
+          const unsigned src_col = Inverse ? (col + 4 - row) % 4 : (col + row) % 4;
+          const uint8_t b = state_byte(lo, hi, 4 * src_col + row);
+          result |= static_cast<uint64_t>(Inverse ? AES_INV_SBOX[b] : AES_SBOX[b]) << (8 * i);
+        }
+        return result;
+      }
+
+#if UDB_CRYPTO_X86
+      inline bool host_has_aes() {
+        static const bool has = __builtin_cpu_supports("aes");
+        return has;
+      }
+      inline bool host_has_pclmul() {
+        static const bool has = __builtin_cpu_supports("pclmul");
+        return has;
+      }
+      inline bool host_has_sha() {
+        static const bool has = __builtin_cpu_supports("sha");
+        return has;
+      }
+
+      __attribute__((target("aes,sse4.1"))) inline uint64_t aesni_round(uint64_t lo, uint64_t hi, bool decrypt, bool mix) {
+        const __m128i state = _mm_set_epi64x(hi, lo);
+        const __m128i zero = _mm_setzero_si128();
+        __m128i r;
+        if (decrypt) {
+          r = mix ? _mm_aesdec_si128(state, zero) : _mm_aesdeclast_si128(state, zero);
+        } else {
+          r = mix ? _mm_aesenc_si128(state, zero) : _mm_aesenclast_si128(state, zero);
+        }
+        return _mm_cvtsi128_si64(r);
+      }
+
+      __attribute__((target("aes,sse4.1"))) inline uint64_t aesni_imc(uint64_t x) {
+        return _mm_cvtsi128_si64(_mm_aesimc_si128(_mm_set_epi64x(0, x)));
+      }
+
+      __attribute__((target("aes,sse4.1"))) inline unsigned __int128 aesni_round128(unsigned __int128 state,
+                                                                                    unsigned __int128 round_key,
+                                                                                    bool decrypt, bool mix) {
+        const __m128i s = _mm_set_epi64x(state >> 64, static_cast<uint64_t>(state));
+        const __m128i k = _mm_set_epi64x(round_key >> 64, static_cast<uint64_t>(round_key));
+        __m128i r;
+        if (decrypt) {
+          // the vector round adds the key before InvMixColumns; AESDEC adds it after
+          r = mix ? _mm_xor_si128(_mm_aesdec_si128(s, _mm_setzero_si128()), _mm_aesimc_si128(k))
+                  : _mm_aesdeclast_si128(s, k);
+        } else {
+          r = mix ? _mm_aesenc_si128(s, k) : _mm_aesenclast_si128(s, k);
+        }
+        return (static_cast<unsigned __int128>(_mm_extract_epi64(r, 1)) << 64) |
+               static_cast<uint64_t>(_mm_cvtsi128_si64(r));
+      }
+
+      // two SHA-256 rounds; the {a, b, e, f} / {c, d, g, h} layout is the one SHA256RNDS2 uses
+      __attribute__((target("sha,sse4.1"))) inline unsigned __int128 shani_rounds(unsigned __int128 cdgh,
+                                                                                 unsigned __int128 abef,
+                                                                                 unsigned __int128 wk) {
+        const __m128i r = _mm_sha256rnds2_epu32(_mm_set_epi64x(cdgh >> 64, static_cast<uint64_t>(cdgh)),
+                                                _mm_set_epi64x(abef >> 64, static_cast<uint64_t>(abef)),
+                                                _mm_set_epi64x(wk >> 64, static_cast<uint64_t>(wk)));
+        return (static_cast<unsigned __int128>(_mm_extract_epi64(r, 1)) << 64) |
+               static_cast<uint64_t>(_mm_cvtsi128_si64(r));
+      }
+
+      __attribute__((target("pclmul,sse4.1"))) inline void pclmul(uint64_t a, uint64_t b, uint64_t& lo, uint64_t& hi) {
+        const __m128i r = _mm_clmulepi64_si128(_mm_set_epi64x(0, a), _mm_set_epi64x(0, b), 0x00);
+        lo = _mm_cvtsi128_si64(r);
+        hi = _mm_extract_epi64(r, 1);
+      }
+#endif
+    }  // namespace detail
+
+    // 128-bit carry-less product of a and b
+    inline void clmul(uint64_t a, uint64_t b, uint64_t& lo, uint64_t& hi) {
+#if UDB_CRYPTO_X86
+      if (detail::host_has_pclmul()) {
+        detail::pclmul(a, b, lo, hi);
+        return;
+      }
+#endif
+      lo = 0;
+      hi = 0;
+      while (b != 0) {
+        const unsigned i = std::countr_zero(b);
+        lo ^= a << i;
+        if (i != 0) {
+          hi ^= a >> (64 - i);
+        }
+        b &= b - 1;
+      }
+    }
+
+    // crossbar permutation of the low `width` bits, with elem_bits-bit elements
+    constexpr uint64_t xperm(uint64_t table, uint64_t indices, unsigned elem_bits, unsigned width) {
+      const uint64_t mask = (1ull << elem_bits) - 1;
+      const unsigned num_elems = width / elem_bits;
+      uint64_t result = 0;
+      for (unsigned i = 0; i < num_elems; i++) {
+        const uint64_t index = (indices >> (i * elem_bits)) & mask;
+        if (index < num_elems) {
+          result |= ((table >> (index * elem_bits)) & mask) << (i * elem_bits);
+        }
+      }
+      return result;
+    }
+
+    // aes32esi / aes32esmi
+    constexpr uint32_t aes32_encrypt(uint32_t rs1, uint32_t rs2, unsigned bs, bool mix) {
+      const uint8_t so = detail::AES_SBOX[(rs2 >> (8 * bs)) & 0xff];
+      const uint32_t mixed = mix
+          ? (detail::gf_mul(so, 2) | (so << 8) | (so << 16) | (static_cast<uint32_t>(detail::gf_mul(so, 3)) << 24))
+          : so;
+      return rs1 ^ std::rotl(mixed, 8 * bs);
+    }
+
+    // aes32dsi / aes32dsmi
+    constexpr uint32_t aes32_decrypt(uint32_t rs1, uint32_t rs2, unsigned bs, bool mix) {
+      const uint8_t so = detail::AES_INV_SBOX[(rs2 >> (8 * bs)) & 0xff];
+      const uint32_t mixed = mix
+          ? (detail::gf_mul(so, 14) | (detail::gf_mul(so, 9) << 8) | (detail::gf_mul(so, 13) << 16) |
+             (static_cast<uint32_t>(detail::gf_mul(so, 11)) << 24))
+          : so;
+      return rs1 ^ std::rotl(mixed, 8 * bs);
+    }
+
+    // aes64es / aes64esm
+    inline uint64_t aes64_encrypt(uint64_t rs1, uint64_t rs2, bool mix) {
+#if UDB_CRYPTO_X86
+      if (detail::host_has_aes()) {
+        return detail::aesni_round(rs1, rs2, false, mix);
+      }
+#endif
+      const uint64_t r = detail::aes64_sub_shift<false>(rs1, rs2);
+      if (!mix) {
+        return r;
+      }
+      return detail::mix_column(static_cast<uint32_t>(r)) |
+             (static_cast<uint64_t>(detail::mix_column(static_cast<uint32_t>(r >> 32))) << 32);
+    }
+
+    // aes64ds / aes64dsm
+    inline uint64_t aes64_decrypt(uint64_t rs1, uint64_t rs2, bool mix) {
+#if UDB_CRYPTO_X86
+      if (detail::host_has_aes()) {
+        return detail::aesni_round(rs1, rs2, true, mix);
+      }
+#endif
+      const uint64_t r = detail::aes64_sub_shift<true>(rs1, rs2);
+      if (!mix) {
+        return r;
+      }
+      return detail::inv_mix_column(static_cast<uint32_t>(r)) |
+             (static_cast<uint64_t>(detail::inv_mix_column(static_cast<uint32_t>(r >> 32))) << 32);
+    }
+
+    // aes64im
+    inline uint64_t aes64_inv_mix_columns(uint64_t rs1) {
+#if UDB_CRYPTO_X86
+      if (detail::host_has_aes()) {
+        return detail::aesni_imc(rs1);
+      }
+#endif
+      return detail::inv_mix_column(static_cast<uint32_t>(rs1)) |
+             (static_cast<uint64_t>(detail::inv_mix_column(static_cast<uint32_t>(rs1 >> 32))) << 32);
+    }
+
+    // aes64ks1i; rnum must be 0 - 10
+    constexpr uint64_t aes64_key_schedule1(uint64_t rs1, unsigned rnum) {
+      constexpr std::array<uint8_t, 10> RCON = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+      uint32_t tmp = rs1 >> 32;
+      uint32_t rc = 0;
+      if (rnum != 0xa) {
+        tmp = std::rotr(tmp, 8);
+        rc = RCON[rnum];
+      }
+      const uint32_t w = detail::sub_word(tmp) ^ rc;
+      return (static_cast<uint64_t>(w) << 32) | w;
+    }
+
+    // aes64ks2
+    constexpr uint64_t aes64_key_schedule2(uint64_t rs1, uint64_t rs2) {
+      const uint32_t w0 = static_cast<uint32_t>(rs1 >> 32) ^ static_cast<uint32_t>(rs2);
+      const uint32_t w1 = w0 ^ static_cast<uint32_t>(rs2 >> 32);
+      return (static_cast<uint64_t>(w1) << 32) | w0;
+    }
+
+    constexpr uint32_t sha256_sig0(uint32_t x) { return std::rotr(x, 7) ^ std::rotr(x, 18) ^ (x >> 3); }
+    constexpr uint32_t sha256_sig1(uint32_t x) { return std::rotr(x, 17) ^ std::rotr(x, 19) ^ (x >> 10); }
+    constexpr uint32_t sha256_sum0(uint32_t x) { return std::rotr(x, 2) ^ std::rotr(x, 13) ^ std::rotr(x, 22); }
+    constexpr uint32_t sha256_sum1(uint32_t x) { return std::rotr(x, 6) ^ std::rotr(x, 11) ^ std::rotr(x, 25); }
+
+    constexpr uint64_t sha512_sig0(uint64_t x) { return std::rotr(x, 1) ^ std::rotr(x, 8) ^ (x >> 7); }
+    constexpr uint64_t sha512_sig1(uint64_t x) { return std::rotr(x, 19) ^ std::rotr(x, 61) ^ (x >> 6); }
+    constexpr uint64_t sha512_sum0(uint64_t x) { return std::rotr(x, 28) ^ std::rotr(x, 34) ^ std::rotr(x, 39); }
+    constexpr uint64_t sha512_sum1(uint64_t x) { return std::rotr(x, 14) ^ std::rotr(x, 18) ^ std::rotr(x, 41); }
+
+    constexpr uint32_t sm3_p0(uint32_t x) { return x ^ std::rotl(x, 9) ^ std::rotl(x, 17); }
+    constexpr uint32_t sm3_p1(uint32_t x) { return x ^ std::rotl(x, 15) ^ std::rotl(x, 23); }
+
+    // sm4ed / sm4ks
+    constexpr uint32_t sm4_round(uint32_t rs1, uint32_t rs2, unsigned bs, bool key_schedule) {
+      // the linear transforms commute with rotation, so each byte can be transformed on its own
+      const uint32_t x = detail::SM4_SBOX[(rs2 >> (8 * bs)) & 0xff];
+      uint32_t z;
+      if (key_schedule) {
+        z = x ^ std::rotl(x, 13) ^ std::rotl(x, 23);  // L'
+      } else {
+        z = x ^ std::rotl(x, 2) ^ std::rotl(x, 10) ^ std::rotl(x, 18) ^ std::rotl(x, 24);  // L
+      }
+      return rs1 ^ std::rotl(z, 8 * bs);
+    }
+
+    // Vector cryptography (Zvkned, Zvkg, Zvknha) works on 128-bit element groups.
+    // Element i of a group is bits 32*i+31:32*i; AES and GHASH bytes are in memory order.
+    using ElementGroup = unsigned __int128;
+
+    namespace detail {
+      constexpr uint32_t eg_word(ElementGroup eg, unsigned i) { return static_cast<uint32_t>(eg >> (32 * i)); }
+
+      constexpr ElementGroup make_eg(uint32_t w0, uint32_t w1, uint32_t w2, uint32_t w3) {
+        return static_cast<ElementGroup>(w0) | (static_cast<ElementGroup>(w1) << 32) |
+               (static_cast<ElementGroup>(w2) << 64) | (static_cast<ElementGroup>(w3) << 96);
+      }
+
+      // reverse the bits in each byte
+      constexpr uint64_t brev8(uint64_t x) {
+        x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+        x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+        return ((x >> 4) & 0x0f0f0f0f0f0f0f0full) | ((x & 0x0f0f0f0f0f0f0f0full) << 4);
+      }
+
+      inline constexpr std::array<uint8_t, 10> AES_RCON = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+    }  // namespace detail
+
+    // vaese[mf]: ShiftRows, SubBytes, MixColumns (if mix), AddRoundKey
+    inline ElementGroup vaes_encrypt_round(ElementGroup state, ElementGroup round_key, bool mix) {
+#if UDB_CRYPTO_X86
+      if (detail::host_has_aes()) {
+        return detail::aesni_round128(state, round_key, false, mix);
+      }
+#endif
+      const uint64_t lo = static_cast<uint64_t>(state), hi = state >> 64;
+      const ElementGroup r = (static_cast<ElementGroup>(aes64_encrypt(hi, lo, mix)) << 64) | aes64_encrypt(lo, hi, mix);
+      return r ^ round_key;
+    }
+
+    // vaesd[mf]: InvShiftRows, InvSubBytes, AddRoundKey, InvMixColumns (if mix)
+    inline ElementGroup vaes_decrypt_round(ElementGroup state, ElementGroup round_key, bool mix) {
+#if UDB_CRYPTO_X86
+      if (detail::host_has_aes()) {
+        return detail::aesni_round128(state, round_key, true, mix);
+      }
+#endif
+      const uint64_t lo = static_cast<uint64_t>(state), hi = state >> 64;
+      const ElementGroup r = ((static_cast<ElementGroup>(detail::aes64_sub_shift<true>(hi, lo)) << 64) |
+                              detail::aes64_sub_shift<true>(lo, hi)) ^
+                             round_key;
+      if (!mix) {
+        return r;
+      }
+      return (static_cast<ElementGroup>(aes64_inv_mix_columns(r >> 64)) << 64) | aes64_inv_mix_columns(r);
+    }
+
+    // vaeskf1: round key rnd (1 - 10) of AES-128 from round key rnd - 1
+    constexpr ElementGroup vaes_key_expand128(ElementGroup key, unsigned rnd) {
+      const uint32_t w0 = detail::eg_word(key, 0) ^ detail::sub_word(std::rotr(detail::eg_word(key, 3), 8)) ^
+                          detail::AES_RCON[rnd - 1];
+      const uint32_t w1 = w0 ^ detail::eg_word(key, 1);
+      const uint32_t w2 = w1 ^ detail::eg_word(key, 2);
+      const uint32_t w3 = w2 ^ detail::eg_word(key, 3);
+      return detail::make_eg(w0, w1, w2, w3);
+    }
+
+    // vaeskf2: round key rnd (2 - 14) of AES-256 from round keys rnd - 2 (prev) and rnd - 1 (key)
+    constexpr ElementGroup vaes_key_expand256(ElementGroup prev, ElementGroup key, unsigned rnd) {
+      const uint32_t last = detail::eg_word(key, 3);
+      uint32_t w0 = detail::eg_word(prev, 0);
+      if (rnd & 1) {
+        w0 ^= detail::sub_word(last);
+      } else {
+        w0 ^= detail::sub_word(std::rotr(last, 8)) ^ detail::AES_RCON[(rnd >> 1) - 1];
+      }
+      const uint32_t w1 = w0 ^ detail::eg_word(prev, 1);
+      const uint32_t w2 = w1 ^ detail::eg_word(prev, 2);
+      const uint32_t w3 = w2 ^ detail::eg_word(prev, 3);
+      return detail::make_eg(w0, w1, w2, w3);
+    }
+
+    // vghsh / vgmul: y * h in GHASH's GF(2^128), operands and result in GCM byte order
+    inline ElementGroup vghash_mul(ElementGroup y, ElementGroup h) {
+      // with the bits of each byte reversed, bit i is the coefficient of x^i
+      const uint64_t a0 = detail::brev8(y), a1 = detail::brev8(y >> 64);
+      const uint64_t b0 = detail::brev8(h), b1 = detail::brev8(h >> 64);
+
+      uint64_t p0, p1, p2, p3, mlo, mhi;
+      clmul(a0, b0, p0, p1);
+      clmul(a1, b1, p2, p3);
+      clmul(a0, b1, mlo, mhi);
+      p1 ^= mlo;
+      p2 ^= mhi;
+      clmul(a1, b0, mlo, mhi);
+      p1 ^= mlo;
+      p2 ^= mhi;
+
+      // reduce modulo x^128 + x^7 + x^2 + x + 1, i.e., x^128 == 0x87
+      uint64_t l2, h2, l3, h3, l4, h4;
+      clmul(p2, 0x87, l2, h2);
+      clmul(p3, 0x87, l3, h3);
+      clmul(h3, 0x87, l4, h4);
+      const uint64_t z0 = p0 ^ l2 ^ l4;
+      const uint64_t z1 = p1 ^ h2 ^ l3;
+      return (static_cast<ElementGroup>(detail::brev8(z1)) << 64) | detail::brev8(z0);
+    }
+
+    // vsha2ms: W[19:16] from w = W[3:0], w_mid = {W[11:9], W[4]}, w_hi = W[15:12]
+    constexpr ElementGroup vsha256_message_schedule(ElementGroup w, ElementGroup w_mid, ElementGroup w_hi) {
+      using detail::eg_word;
+      const uint32_t w16 = sha256_sig1(eg_word(w_hi, 2)) + eg_word(w_mid, 1) + sha256_sig0(eg_word(w, 1)) + eg_word(w, 0);
+      const uint32_t w17 = sha256_sig1(eg_word(w_hi, 3)) + eg_word(w_mid, 2) + sha256_sig0(eg_word(w, 2)) + eg_word(w, 1);
+      const uint32_t w18 = sha256_sig1(w16) + eg_word(w_mid, 3) + sha256_sig0(eg_word(w, 3)) + eg_word(w, 2);
+      const uint32_t w19 = sha256_sig1(w17) + eg_word(w_hi, 0) + sha256_sig0(eg_word(w_mid, 0)) + eg_word(w, 3);
+      return detail::make_eg(w16, w17, w18, w19);
+    }
+
+    // vsha2c[lh]: two SHA-256 rounds with the message words (plus K) in elements 1:0 (or 3:2 if high) of wk.
+    // Returns the new {a, b, e, f}.
+    inline ElementGroup vsha256_compress(ElementGroup cdgh, ElementGroup abef, ElementGroup wk, bool high) {
+      if (high) {
+        wk >>= 64;
+      }
+#if UDB_CRYPTO_X86
+      if (detail::host_has_sha()) {
+        return detail::shani_rounds(cdgh, abef, wk);
+      }
+#endif
+      using detail::eg_word;
+      uint32_t a = eg_word(abef, 3), b = eg_word(abef, 2), e = eg_word(abef, 1), f = eg_word(abef, 0);
+      uint32_t c = eg_word(cdgh, 3), d = eg_word(cdgh, 2), g = eg_word(cdgh, 1), h = eg_word(cdgh, 0);
+      for (unsigned i = 0; i < 2; i++) {
+        const uint32_t t1 = h + sha256_sum1(e) + ((e & f) ^ (~e & g)) + eg_word(wk, i);
+        const uint32_t t2 = sha256_sum0(a) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+      }
+      return detail::make_eg(f, e, b, a);
+    }
+
+  }  // namespace crypto
+}  // namespace udb
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <map>
 #include <memory>
@@ -10,12 +11,21 @@
 #include <utility>
 #include <vector>
 
+#include "udb/bg_translator.hpp"
 #include "udb/bits.hpp"
+#include "udb/code_page_tracker.hpp"
+#include "udb/crypto.hpp"
 #include "udb/csr.hpp"
 #include "udb/db_data.hxx"
 #include "udb/enum.hxx"
+#include "udb/hpm_counters.hpp"
+#include "udb/instret_counter.hpp"
+#include "udb/jump_table_cache.hpp"
+#include "udb/shared_bb_cache.hpp"
 #include "udb/soc_model.hpp"
+#include "udb/soft_tlb.hpp"
 #include "udb/stop_reason.h"
+#include "udb/timing_model.hpp"
 #include "udb/version.hpp"
 
 #if !defined(JSON_ASSERT)
@@ -43,13 +53,37 @@ namespace udb {
 
   class InstBase;
 
+  // sizes of the per-hart caches
+  //
+  // cache storage is only allocated when a cache is first used
+  struct HartCacheConfig {
+    unsigned bb_cache_blocks = 8192;   // number of basic blocks; power of two
+    unsigned soft_tlb_entries = 1024;  // entries per soft TLB; power of two
+  };
+
+  // host memory held by a single hart, in bytes
+  struct HartMemoryUsage {
+    size_t hart_object = 0;    // the hart itself, including CSRs and registers
+    size_t bb_cache = 0;       // allocated basic block cache storage
+    size_t soft_tlb = 0;       // allocated soft TLB storage
+    size_t shared_tables = 0;  // per-config tables shared by all harts (approximate)
+
+    // total owned by this hart (shared tables are not included)
+    size_t total() const { return hart_object + bb_cache + soft_tlb; }
+  };
+
   template <SocModel SocType>
   class HartBase {
    public:
     HartBase(unsigned hart_id, SocType& soc, const Config& cfg)
+        : HartBase(hart_id, soc, std::make_shared<const Config>(cfg)) {}
+
+    // harts created from the same configuration can share a single Config
+    HartBase(unsigned hart_id, SocType& soc, std::shared_ptr<const Config> cfg)
         : m_hart_id(hart_id),
           m_soc(soc),
-          m_cfg(cfg),
+          m_shared_cfg(std::move(cfg)),
+          m_cfg(*m_shared_cfg),
           m_tracer(nullptr),
           m_current_priv_mode(PrivilegeMode::M),
           m_exit_requested(false),
@@ -57,7 +91,19 @@ namespace udb {
 
     virtual void reset(uint64_t reset_pc) {
       m_exit_requested = 0;
+      m_requested_stop = StopReason::InstLimitReached;
       m_num_inst_exec = 0;
+      m_num_inst_trapped = 0;
+      m_cycles_fx = 0;
+      m_mcycle_offset = 0;
+      m_hpm.reset();
+      m_jt_cache.invalidate();
+      m_trap_routing.valid = false;
+      m_tlb_state.valid = false;
+      invalidate_all_translations();
+      m_instret.reset();
+      m_instret_inhibit_all = false;
+      m_instret_inhibit_modes = 0;
     }
 
     void attach_tracer(AbstractTracer* t) {
@@ -76,6 +122,9 @@ namespace udb {
     PrivilegeMode mode() const { return m_current_priv_mode; }
     void set_mode(const PrivilegeMode& next_mode) {
       m_current_priv_mode = next_mode;
+      if (m_instret_inhibit_modes != 0) [[unlikely]] {
+        update_instret_counting();
+      }
     }
 
     // access a physical address. All translations and physical checks
@@ -126,29 +175,86 @@ namespace udb {
       if (m_tracer != nullptr) {
         m_tracer->trace_exception();
       }
+      if (m_hpm.active()) {
+        m_hpm.count_trap();
+      }
       throw AbortInstruction();
     }
 
+    // wfi may complete immediately. Only stop the hart (so the caller can park it)
+    // when there's nothing to wake up for yet.
     void wfi() {
-      //Do nothing for now
-      //throw WfiException();
+      if (!wakeup_pending()) {
+        throw WfiException();
+      }
     }
 
-    void pause() {
-      //Do nothing for now
-      //throw PauseException();
+    // true if an interrupt is both pending and enabled in mie, ignoring the global
+    // enables. This is the condition that ends a wfi.
+    virtual bool wakeup_pending() = 0;
+
+    // pause (and wrs.sto) give up the rest of the hart's quantum, so that the
+    // hart it's waiting on can run
+    void pause() { request_stop(StopReason::Pause); }
+
+    // wrs.nto/wrs.sto. An unbounded wait parks the hart the same way as a polling loop
+    // (see enable_spin_detection), watching the reservation set for a write; without
+    // spin detection, or for a bounded wait, it is a pause.
+    void wait_on_reservation_set(const PossiblyUnknownBits<64>& paddr, const PossiblyUnknownBits<64>& size,
+                                 bool short_timeout) {
+      if (wakeup_pending()) {
+        return;  // as for wfi, a pending interrupt ends the wait
+      }
+      const uint64_t bytes = size.get();
+      if (short_timeout || !m_spin_detect || bytes > 8 * WatchedLoads::MAX_LOADS) {
+        request_stop(StopReason::Pause);
+        return;
+      }
+      m_spin_loads.clear();
+      for (uint64_t offset = 0; offset < bytes; offset += 8) {
+        const uint64_t addr = paddr.get() + offset;
+        const unsigned len = std::min<uint64_t>(8, bytes - offset);
+        m_spin_loads.add(addr, len, read_watched(addr, len));
+      }
+      request_stop(StopReason::SpinLoop);
     }
 
     // SoC functions
+    // counters selecting a simulator event (see HpmCounters) are counted by the hart;
+    // any others are left to the SoC
     PossiblyUnknownBits<64> read_hpm_counter(const PossiblyUnknownBits<64>& counternum) {
-      return Bits<64>{m_soc.read_hpm_counter(counternum.get())};
+      const unsigned n = counternum.get();
+      if (m_hpm.programmed(n)) {
+        return Bits<64>{m_hpm.read(n)};
+      }
+      return Bits<64>{m_soc.read_hpm_counter(n)};
+    }
+    // with a timing model, mcycle counts this hart's modeled cycles; otherwise the SoC provides it
+    PossiblyUnknownBits<64> read_mcycle() {
+      if (m_timing != nullptr) {
+        return Bits<64>{cycles() + m_mcycle_offset};
+      }
+      return Bits<64>{m_soc.read_mcycle()};
     }
-    PossiblyUnknownBits<64> read_mcycle() { return Bits<64>{m_soc.read_mcycle()}; }
     PossiblyUnknownBits<64> read_mtime() { return Bits<64>{m_soc.read_mtime()}; }
+
+    // minstret is not stored; see InstretCounter
+    PossiblyUnknownBits<64> read_minstret() { return Bits<64>{m_instret.read(num_insts_retired())}; }
+    PossiblyUnknownBits<64> sw_write_minstret(const PossiblyUnknownBits<64>& value) {
+      m_instret.sw_write(value.get(), num_insts_retired());
+      return value;
+    }
     PossiblyUnknownBits<64> sw_write_mcycle(const PossiblyUnknownBits<64>& value) {
+      if (m_timing != nullptr) {
+        m_mcycle_offset = value.get() - cycles();
+        return value;
+      }
       return Bits<64>(m_soc.sw_write_mcycle(value.get()));
     }
-    void cache_block_zero(const PossiblyUnknownBits<64>& paddr) { m_soc.cache_block_zero(paddr.get()); }
+    void cache_block_zero(const PossiblyUnknownBits<64>& paddr, const PossiblyUnknownBits<32>& size) {
+      note_store(paddr.get(), size.get());
+      m_soc.cache_block_zero(paddr.get(), size.get());
+    }
     void eei_ecall_from_m() { m_soc.eei_ecall_from_m(); }
     void eei_ecall_from_s() { m_soc.eei_ecall_from_s(); }
     void eei_ecall_from_u() { m_soc.eei_ecall_from_u(); }
@@ -171,7 +277,11 @@ namespace udb {
       m_soc.fence(pi, pr, po, pw, si, sr, so, sw);
     }
     void fence_tso() { m_soc.fence_tso(); }
-    virtual void ifence() { m_soc.ifence(); }
+    virtual void ifence() {
+      // jump tables are fetched like instructions, so fence.i also covers them
+      m_jt_cache.invalidate();
+      m_soc.ifence();
+    }
 
     template <typename... Args>
     void order_pgtbl_writes_before_vmafence(Args...) {
@@ -185,39 +295,67 @@ namespace udb {
       m_soc.order_pgtbl_reads_after_vmafence();
     }
     Bits<8> read_physical_memory_8(const PossiblyUnknownBits<64>& paddr) {
-      return Bits<8>{m_soc.read_physical_memory_8(paddr.get())};
+      const uint64_t value = m_soc.read_physical_memory_8(paddr.get());
+      if (m_load_watch != nullptr) [[unlikely]] {
+        m_load_watch->add(paddr.get(), 1, value);
+      }
+      return Bits<8>{value};
     }
     Bits<16> read_physical_memory_16(const PossiblyUnknownBits<64>& paddr) {
-      return Bits<16>{m_soc.read_physical_memory_16(paddr.get())};
+      if (m_fetch_pages != nullptr) [[unlikely]] {
+        note_fetch(paddr.get());
+      }
+      const uint64_t value = m_soc.read_physical_memory_16(paddr.get());
+      if (m_load_watch != nullptr) [[unlikely]] {
+        m_load_watch->add(paddr.get(), 2, value);
+      }
+      return Bits<16>{value};
     }
     Bits<32> read_physical_memory_32(const PossiblyUnknownBits<64>& paddr) {
-      return Bits<32>{m_soc.read_physical_memory_32(paddr.get())};
+      if (m_fetch_pages != nullptr) [[unlikely]] {
+        note_fetch(paddr.get());
+      }
+      const uint64_t value = m_soc.read_physical_memory_32(paddr.get());
+      if (m_load_watch != nullptr) [[unlikely]] {
+        m_load_watch->add(paddr.get(), 4, value);
+      }
+      return Bits<32>{value};
     }
     Bits<64> read_physical_memory_64(const PossiblyUnknownBits<64>& paddr) {
-      return Bits<64>{m_soc.read_physical_memory_64(paddr.get())};
+      const uint64_t value = m_soc.read_physical_memory_64(paddr.get());
+      if (m_load_watch != nullptr) [[unlikely]] {
+        m_load_watch->add(paddr.get(), 8, value);
+      }
+      return Bits<64>{value};
     }
     void write_physical_memory_8(const PossiblyUnknownBits<64>& paddr, const PossiblyUnknownBits<8>& value) {
+      note_store(paddr.get(), 1);
       m_soc.write_physical_memory_8(paddr.get(), value.get());
     }
     void write_physical_memory_16(const PossiblyUnknownBits<64>& paddr,
                                   const PossiblyUnknownBits<16>& value) {
+      note_store(paddr.get(), 2);
       m_soc.write_physical_memory_16(paddr.get(), value.get());
     }
     void write_physical_memory_32(const PossiblyUnknownBits<64>& paddr,
                                   const PossiblyUnknownBits<32>& value) {
+      note_store(paddr.get(), 4);
       m_soc.write_physical_memory_32(paddr.get(), value.get());
     }
     void write_physical_memory_64(const PossiblyUnknownBits<64>& paddr,
                                   const PossiblyUnknownBits<64>& value) {
+      note_store(paddr.get(), 8);
       m_soc.write_physical_memory_64(paddr.get(), value.get());
     }
     bool atomic_check_then_write_32(const PossiblyUnknownBits<64>& paddr, const PossiblyUnknownBits<32>& compare_value,
                                     const PossiblyUnknownBits<32>& write_value) {
+      note_store(paddr.get(), 4);
       return m_soc.atomic_check_then_write_32(paddr.get(), compare_value.get(),
                                               write_value.get());
     }
     bool atomic_check_then_write_64(const PossiblyUnknownBits<64>& paddr, const PossiblyUnknownBits<64>& compare_value,
                                     const PossiblyUnknownBits<64>& write_value) {
+      note_store(paddr.get(), 8);
       return m_soc.atomic_check_then_write_64(paddr.get(), compare_value.get(),
                                               write_value.get());
     }
@@ -231,10 +369,12 @@ namespace udb {
     }
     Bits<32> atomic_read_modify_write_32(const PossiblyUnknownBits<64>& paddr, const PossiblyUnknownBits<32>& value,
                                          AmoOperation op) {
+      note_store(paddr.get(), 4);
       return Bits<32>{m_soc.atomic_read_modify_write_32(paddr.get(), value.get(), op)};
     }
     Bits<64> atomic_read_modify_write_64(const PossiblyUnknownBits<64>& paddr, const PossiblyUnknownBits<64>& value,
                                          AmoOperation op) {
+      note_store(paddr.get(), 8);
       return Bits<64>{m_soc.atomic_read_modify_write_64(paddr.get(), value.get(), op)};
     }
     bool pma_applies_Q_(const PmaAttribute& attr, PossiblyUnknownBits<64> start_paddr,
@@ -253,54 +393,231 @@ namespace udb {
     //
     // virtual memory caching builtins
     //
+    // Translations are cached in soft TLBs (see soft_tlb.hpp), a read, write, and execute
+    // TLB for each of S-mode, VS-mode, and G-stage translation. Each TLB is a direct-mapped
+    // array of 4 KiB entries plus a SoftSuperpageTlb for larger pages. VS-mode entries hold the combined guest-virtual to host-physical
+    // translation; the G-stage TLBs cache the second stage on its own, for guest page-table
+    // walks and VS-mode misses. Entries are tagged with a translation context, the ASID,
+    // and the VMID (see TlbState), so switching between address spaces keeps them warm.
+
+    enum SoftTlbKind {
+      SmodeReadTlb,
+      SmodeWriteTlb,
+      SmodeExeTlb,
+      VsmodeReadTlb,
+      VsmodeWriteTlb,
+      VsmodeExeTlb,
+      GstageReadTlb,
+      GstageWriteTlb,
+      GstageExeTlb,
+      NumSoftTlbKinds
+    };
 
-    struct SoftTlbEntry {
-      bool valid;
-      bool global;
-      bool smode;   // was translation satp-based?
-      bool vsmode;  // was translation vsatp-based?
-      bool gstage;  // was translation hgatp-based?
+    // return the first entry of the soft TLB 'kind'
+    // the TLBs are allocated (invalid) on first use
+    SoftTlbEntry* soft_tlb(SoftTlbKind kind) {
+      if (!m_soft_tlbs) [[unlikely]] {
+        m_soft_tlbs = std::make_unique<SoftTlbEntry[]>(NumSoftTlbKinds * m_soft_tlb_size);
+        m_superpage_tlbs = std::make_unique<SoftSuperpageTlb[]>(NumSoftTlbKinds);
+      }
+      return &m_soft_tlbs[kind * m_soft_tlb_size];
+    }
+    unsigned soft_tlb_size() const { return m_soft_tlb_size; }
 
-      Bits<16> asid;
-      Bits<16> vmid;
+    // the entry of soft TLB 'kind' that translates 4 KiB page 'vpn', or nullptr
+    const SoftTlbEntry* soft_tlb_find(SoftTlbKind kind, uint64_t vpn, uint64_t ctx, uint8_t mode,
+                                      uint16_t asid, uint16_t vmid) {
+      const SoftTlbEntry& entry = soft_tlb(kind)[vpn & (m_soft_tlb_size - 1)];
+      if (entry.matches(vpn, ctx, mode, asid, vmid)) {
+        return &entry;
+      }
+      return m_superpage_tlbs[kind].lookup(vpn, ctx, mode, asid, vmid);
+    }
 
-      uint64_t vpn;     // virtual page number
-      uint64_t ppn;     // physical page number
-      uintptr_t vaddr;  // offset to the page in *host* memory; ~0 = not valid
-      uintptr_t paddr;  // offset to the page in *host* memory; ~0 = not valid
-    };
+    // the TLB for accesses of type 'op' in the group whose read TLB is 'read_kind'
+    static SoftTlbKind soft_tlb_kind(SoftTlbKind read_kind, const MemoryOperation& op) {
+      if (op == MemoryOperation::Read) {
+        return read_kind;
+      } else if (op == MemoryOperation::Fetch) {
+        return static_cast<SoftTlbKind>(read_kind + 2);
+      }
+      return static_cast<SoftTlbKind>(read_kind + 1);
+    }
 
-    constexpr static unsigned SOFT_TLB_SIZE = 1024;
+    // A read-modify-write needs both read and write permission, so it is filled into both
+    // the read and the write TLB, and hits only when the page is in both.
+    const SoftTlbEntry* soft_tlb_lookup(SoftTlbKind read_kind, const MemoryOperation& op, uint64_t vpn,
+                                        uint64_t ctx, uint8_t mode, uint16_t asid, uint16_t vmid) {
+      const SoftTlbEntry* entry = soft_tlb_find(soft_tlb_kind(read_kind, op), vpn, ctx, mode, asid, vmid);
+      if (entry == nullptr) {
+        return nullptr;
+      }
+      if (op == MemoryOperation::ReadModifyWrite &&
+          soft_tlb_find(read_kind, vpn, ctx, mode, asid, vmid) == nullptr) {
+        return nullptr;
+      }
+      return entry;
+    }
 
-    SoftTlbEntry m_va_smode_read_tlb[SOFT_TLB_SIZE];
-    SoftTlbEntry m_va_smode_write_tlb[SOFT_TLB_SIZE];
-    SoftTlbEntry m_va_smode_exe_tlb[SOFT_TLB_SIZE];
+    void soft_tlb_fill(SoftTlbKind read_kind, const MemoryOperation& op, const SoftTlbEntry& entry) {
+      soft_tlb_insert(soft_tlb_kind(read_kind, op), entry);
+      if (op == MemoryOperation::ReadModifyWrite) {
+        soft_tlb_insert(read_kind, entry);
+      }
+    }
 
-    SoftTlbEntry m_va_vsmode_read_tlb[SOFT_TLB_SIZE];
-    SoftTlbEntry m_va_vsmode_write_tlb[SOFT_TLB_SIZE];
-    SoftTlbEntry m_va_vsmode_exe_tlb[SOFT_TLB_SIZE];
+    void soft_tlb_insert(SoftTlbKind kind, const SoftTlbEntry& entry) {
+      if (entry.shift == 12) {
+        soft_tlb(kind)[entry.vpn & (m_soft_tlb_size - 1)] = entry;
+      } else {
+        soft_tlb(kind);  // allocate
+        m_superpage_tlbs[kind].fill(entry);
+      }
+    }
 
-    SoftTlbEntry m_va_gstage_read_tlb[SOFT_TLB_SIZE];
-    SoftTlbEntry m_va_gstage_write_tlb[SOFT_TLB_SIZE];
-    SoftTlbEntry m_va_gstage_exe_tlb[SOFT_TLB_SIZE];
+    // apply 'fence' to the read, write, and execute TLBs of the group whose read TLB is 'read_kind'
+    void fence_soft_tlbs(SoftTlbKind read_kind, const SoftTlbFence& fence) {
+      for (unsigned kind = read_kind; kind < read_kind + 3u; kind++) {
+        soft_tlb_fence(&m_soft_tlbs[kind * m_soft_tlb_size], m_soft_tlb_size, fence);
+        m_superpage_tlbs[kind].fence(fence);
+      }
+    }
 
+    // sfence.vma, hfence.vvma, and hfence.gvma (and their Svinval forms)
     template <typename VmaOrderType>
-    void invalidate_translations(const VmaOrderType&) {}
+    void invalidate_translations(const VmaOrderType& inval) {
+      m_translation_epoch++;
+      m_jt_cache.invalidate();
+      if (!m_soft_tlbs) {
+        return;
+      }
+      if (!inval.smode && !inval.vsmode && !inval.gstage) {
+        invalidate_all_translations();
+        return;
+      }
 
-    void invalidate_all_translations() {}
+      SoftTlbFence fence;
+      fence.single_vmid = inval.single_vmid;
+      fence.vmid = static_cast<uint16_t>(inval.vmid.get_ignore_unknown());
+      if (inval.gstage) {
+        // G-stage entries are tagged by guest physical page. Combined VS-mode entries don't
+        // record the guest physical page they went through, so drop all of the VMID's.
+        fence.single_page = inval.single_gpaddr;
+        fence.vpn = inval.gpaddr.get_ignore_unknown() >> 12;
+        fence_soft_tlbs(GstageReadTlb, fence);
+        fence.single_page = false;
+        fence_soft_tlbs(VsmodeReadTlb, fence);
+      }
+      if (inval.smode || inval.vsmode) {
+        fence.single_asid = inval.single_asid;
+        fence.asid = static_cast<uint16_t>(inval.asid.get_ignore_unknown());
+        fence.single_page = inval.single_vaddr;
+        fence.vpn = inval.vaddr.get_ignore_unknown() >> 12;
+        fence_soft_tlbs(inval.vsmode ? VsmodeReadTlb : SmodeReadTlb, fence);
+      }
+    }
+
+    void invalidate_all_translations() {
+      m_translation_epoch++;
+      if (m_soft_tlbs) {
+        for (unsigned i = 0; i < NumSoftTlbKinds * m_soft_tlb_size; i++) {
+          m_soft_tlbs[i].valid = false;
+        }
+        for (unsigned kind = 0; kind < NumSoftTlbKinds; kind++) {
+          m_superpage_tlbs[kind].invalidate();
+        }
+      }
+    }
     void invalidate_asid_translations(const PossiblyUnknownBits<16>& asid) {}
     void invalidate_vaddr_translations(uint64_t vaddr) {}
     void invalidate_asid_vaddr_translations(const PossiblyUnknownBits<16>& asid, const PossiblyUnknownRuntimeBits<64>& vaddr) {}
 
-    template <typename TranslationResult>
-    void maybe_cache_translation(const PossiblyUnknownBits<64>& vaddr, MemoryOperation op,
-                                 TranslationResult result) {}
-
     void sfence_all() {}
     void sfence_asid(const PossiblyUnknownBits<16>& asid) {}
     void sfence_vaddr(const PossiblyUnknownBits<64>& vaddr) {}
     void sfence_asid_vaddr(const PossiblyUnknownBits<16>& asid, const PossiblyUnknownBits<64>& vaddr) {}
 
+    // scalar cryptography (see crypto.idl)
+    Bits<64> clmul_low(const PossiblyUnknownBits<64>& a, const PossiblyUnknownBits<64>& b) {
+      uint64_t lo, hi;
+      crypto::clmul(a.get(), b.get(), lo, hi);
+      return Bits<64>{lo};
+    }
+    Bits<64> clmul_high(const PossiblyUnknownBits<64>& a, const PossiblyUnknownBits<64>& b) {
+      uint64_t lo, hi;
+      crypto::clmul(a.get(), b.get(), lo, hi);
+      return Bits<64>{hi};
+    }
+    Bits<64> xperm(const PossiblyUnknownBits<64>& table, const PossiblyUnknownBits<64>& indices,
+                   const PossiblyUnknownBits<4>& elem_bits, const PossiblyUnknownBits<7>& width) {
+      return Bits<64>{crypto::xperm(table.get(), indices.get(), elem_bits.get(), width.get())};
+    }
+    Bits<32> aes32_encrypt(const PossiblyUnknownBits<32>& rs1, const PossiblyUnknownBits<32>& rs2,
+                           const PossiblyUnknownBits<2>& bs, bool mix) {
+      return Bits<32>{crypto::aes32_encrypt(rs1.get(), rs2.get(), bs.get(), mix)};
+    }
+    Bits<32> aes32_decrypt(const PossiblyUnknownBits<32>& rs1, const PossiblyUnknownBits<32>& rs2,
+                           const PossiblyUnknownBits<2>& bs, bool mix) {
+      return Bits<32>{crypto::aes32_decrypt(rs1.get(), rs2.get(), bs.get(), mix)};
+    }
+    Bits<64> aes64_encrypt(const PossiblyUnknownBits<64>& rs1, const PossiblyUnknownBits<64>& rs2, bool mix) {
+      return Bits<64>{crypto::aes64_encrypt(rs1.get(), rs2.get(), mix)};
+    }
+    Bits<64> aes64_decrypt(const PossiblyUnknownBits<64>& rs1, const PossiblyUnknownBits<64>& rs2, bool mix) {
+      return Bits<64>{crypto::aes64_decrypt(rs1.get(), rs2.get(), mix)};
+    }
+    Bits<64> aes64_inv_mix_columns(const PossiblyUnknownBits<64>& rs1) {
+      return Bits<64>{crypto::aes64_inv_mix_columns(rs1.get())};
+    }
+    Bits<64> aes64_key_schedule1(const PossiblyUnknownBits<64>& rs1, const PossiblyUnknownBits<4>& rnum) {
+      return Bits<64>{crypto::aes64_key_schedule1(rs1.get(), rnum.get())};
+    }
+    Bits<64> aes64_key_schedule2(const PossiblyUnknownBits<64>& rs1, const PossiblyUnknownBits<64>& rs2) {
+      return Bits<64>{crypto::aes64_key_schedule2(rs1.get(), rs2.get())};
+    }
+    Bits<32> sha256_sig0(const PossiblyUnknownBits<32>& x) { return Bits<32>{crypto::sha256_sig0(x.get())}; }
+    Bits<32> sha256_sig1(const PossiblyUnknownBits<32>& x) { return Bits<32>{crypto::sha256_sig1(x.get())}; }
+    Bits<32> sha256_sum0(const PossiblyUnknownBits<32>& x) { return Bits<32>{crypto::sha256_sum0(x.get())}; }
+    Bits<32> sha256_sum1(const PossiblyUnknownBits<32>& x) { return Bits<32>{crypto::sha256_sum1(x.get())}; }
+    Bits<64> sha512_sig0(const PossiblyUnknownBits<64>& x) { return Bits<64>{crypto::sha512_sig0(x.get())}; }
+    Bits<64> sha512_sig1(const PossiblyUnknownBits<64>& x) { return Bits<64>{crypto::sha512_sig1(x.get())}; }
+    Bits<64> sha512_sum0(const PossiblyUnknownBits<64>& x) { return Bits<64>{crypto::sha512_sum0(x.get())}; }
+    Bits<64> sha512_sum1(const PossiblyUnknownBits<64>& x) { return Bits<64>{crypto::sha512_sum1(x.get())}; }
+    Bits<32> sm3_p0(const PossiblyUnknownBits<32>& x) { return Bits<32>{crypto::sm3_p0(x.get())}; }
+    Bits<32> sm3_p1(const PossiblyUnknownBits<32>& x) { return Bits<32>{crypto::sm3_p1(x.get())}; }
+    Bits<32> sm4_round(const PossiblyUnknownBits<32>& rs1, const PossiblyUnknownBits<32>& rs2,
+                       const PossiblyUnknownBits<2>& bs, bool key_schedule) {
+      return Bits<32>{crypto::sm4_round(rs1.get(), rs2.get(), bs.get(), key_schedule)};
+    }
+
+    // vector cryptography, one 128-bit element group at a time (see crypto.idl)
+    Bits<128> vaes_encrypt_round(const PossiblyUnknownBits<128>& state, const PossiblyUnknownBits<128>& round_key,
+                                 bool mix) {
+      return Bits<128>{crypto::vaes_encrypt_round(state.get(), round_key.get(), mix)};
+    }
+    Bits<128> vaes_decrypt_round(const PossiblyUnknownBits<128>& state, const PossiblyUnknownBits<128>& round_key,
+                                 bool mix) {
+      return Bits<128>{crypto::vaes_decrypt_round(state.get(), round_key.get(), mix)};
+    }
+    Bits<128> vaes_key_expand128(const PossiblyUnknownBits<128>& key, const PossiblyUnknownBits<4>& rnd) {
+      return Bits<128>{crypto::vaes_key_expand128(key.get(), rnd.get())};
+    }
+    Bits<128> vaes_key_expand256(const PossiblyUnknownBits<128>& prev, const PossiblyUnknownBits<128>& key,
+                                 const PossiblyUnknownBits<4>& rnd) {
+      return Bits<128>{crypto::vaes_key_expand256(prev.get(), key.get(), rnd.get())};
+    }
+    Bits<128> vghash_mul(const PossiblyUnknownBits<128>& y, const PossiblyUnknownBits<128>& h) {
+      return Bits<128>{crypto::vghash_mul(y.get(), h.get())};
+    }
+    Bits<128> vsha256_message_schedule(const PossiblyUnknownBits<128>& w, const PossiblyUnknownBits<128>& w_mid,
+                                       const PossiblyUnknownBits<128>& w_hi) {
+      return Bits<128>{crypto::vsha256_message_schedule(w.get(), w_mid.get(), w_hi.get())};
+    }
+    Bits<128> vsha256_compress(const PossiblyUnknownBits<128>& cdgh, const PossiblyUnknownBits<128>& abef,
+                               const PossiblyUnknownBits<128>& wk, bool high) {
+      return Bits<128>{crypto::vsha256_compress(cdgh.get(), abef.get(), wk.get(), high)};
+    }
+
     // Return true if the address at paddr has the PMA attribute 'attr'
     bool check_pma(const PossiblyUnknownBits<64>& paddr, const PmaAttribute& attr) const {
       return true;
@@ -314,6 +631,105 @@ namespace udb {
     void sync_read_after_write_device(bool completed, const PossiblyUnknownBits<32>& write_bitmask) { m_soc.sync_read_after_write_device(completed, write_bitmask.get()); }
     void sync_write_after_read_device(bool completed, const PossiblyUnknownBits<32>& write_bitmask) { m_soc.sync_write_after_read_device(completed, write_bitmask.get()); }
 
+    // resize the per-hart caches. Any cached state is discarded.
+    virtual void configure_caches(const HartCacheConfig& cfg) {
+      udb_assert((cfg.soft_tlb_entries != 0) && (__builtin_popcount(cfg.soft_tlb_entries) == 1),
+                 "Soft TLB size must be a power of two");
+      m_soft_tlb_size = cfg.soft_tlb_entries;
+      m_soft_tlbs.reset();
+      m_superpage_tlbs.reset();
+    }
+
+    virtual HartMemoryUsage memory_usage() const {
+      HartMemoryUsage usage;
+      usage.soft_tlb =
+          m_soft_tlbs ? NumSoftTlbKinds * (m_soft_tlb_size * sizeof(SoftTlbEntry) + sizeof(SoftSuperpageTlb)) : 0;
+      return usage;
+    }
+
+    void print_memory_usage(FILE* out = stdout) const {
+      HartMemoryUsage usage = memory_usage();
+      fmt::print(out, "Hart {} memory usage (bytes):\n", m_hart_id);
+      fmt::print(out, "  hart object       : {}\n", usage.hart_object);
+      fmt::print(out, "  basic block cache : {}\n", usage.bb_cache);
+      fmt::print(out, "  soft TLB          : {}\n", usage.soft_tlb);
+      fmt::print(out, "  total             : {}\n", usage.total());
+      fmt::print(out, "  shared per config : {}\n", usage.shared_tables);
+    }
+
+    // use a translation cache shared with other harts of the same config.
+    // Must be called before the hart starts running.
+    virtual void attach_shared_bb_cache(std::shared_ptr<SharedBlockCache> cache) {
+      m_shared_bb_reader = cache->register_reader();
+      m_shared_bb_cache = std::move(cache);
+    }
+    SharedBlockCache* shared_bb_cache() const { return m_shared_bb_cache.get(); }
+
+    // track stores to cached code with a tracker shared by every hart of the system.
+    // Without a tracker, fence.i flushes all cached blocks.
+    void attach_code_tracker(std::shared_ptr<CodePageTracker> tracker) {
+      m_code_seq = tracker->sequence();
+      m_code_tracker = std::move(tracker);
+    }
+
+    // invalidate cached blocks on pages written since the last call
+    virtual void sync_code_writes() = 0;
+
+    // charge modeled cycles for each instruction run. The model may be shared by many
+    // harts and must outlive them. Pass nullptr to stop modeling.
+    void attach_timing_model(const TimingModel* timing) { m_timing = timing; }
+    const TimingModel* timing_model() const { return m_timing; }
+
+    // modeled cycles run so far (0 without a timing model)
+    uint64_t cycles() const { return TimingModel::to_cycles(m_cycles_fx); }
+
+    // event-backed hpm counters
+    const HpmCounters& hpm_counters() const { return m_hpm; }
+
+    // Stop with StopReason::SpinLoop when the hart is stuck polling: a block that
+    // branches to itself, doesn't store, and leaves the registers unchanged. The
+    // caller can then park the hart until spin_wakeup_pending().
+    //
+    // Only enable this when every write to memory comes from a hart or device the
+    // caller knows about; otherwise a parked hart may never notice the write it's
+    // waiting for.
+    void enable_spin_detection(bool enable) { m_spin_detect = enable; }
+
+    // true if a hart stopped with StopReason::SpinLoop could now make progress:
+    // a location it polls has changed, or it has an interrupt to take
+    bool spin_wakeup_pending() {
+      for (unsigned i = 0; i < m_spin_loads.num; i++) {
+        const auto& l = m_spin_loads.loads[i];
+        if (read_watched(l.paddr, l.bytes) != l.value) {
+          return true;
+        }
+      }
+      return wakeup_pending();
+    }
+
+    // platform (e.g., CLINT) interrupt lines
+    virtual void set_mmode_timer_int() = 0;
+    virtual void clear_mmode_timer_int() = 0;
+    virtual void set_mmode_sw_int() = 0;
+    virtual void clear_mmode_sw_int() = 0;
+
+    // hand blocks this hart is likely to run soon to a background translator.
+    // The translator must publish to the same shared cache this hart uses.
+    void attach_bg_translator(BackgroundTranslator* bg) {
+      udb_assert(m_shared_bb_cache.get() == &bg->cache(),
+                 "Background translator must use the hart's shared block cache");
+      m_bg_producer = bg->register_producer();
+      m_bg_translator = bg;
+    }
+
+    // decode the code copied into a background translator candidate, without executing
+    // it. Only call this on a hart that is not running.
+    virtual bool translate_block(const BackgroundTranslator::Candidate& c, SharedBlockRecord& rec) = 0;
+
+    // changes whenever the generated decoder (instruction list) changes; used to key
+    // persistent translation caches
+    virtual uint64_t decode_signature() const = 0;
+
     // xlen of M-mode, i.e., MXLEN
     virtual unsigned mxlen() = 0;
 
@@ -355,6 +771,19 @@ namespace udb {
     // called by the ISS; ask the hart to exit (from run_*) immediately
     void request_exit() { m_exit_requested = true; }
 
+    // called by an instruction; once it completes, exit from run_* with reason
+    void request_stop(int reason) {
+      m_requested_stop = reason;
+      m_exit_requested = true;
+    }
+
+    // what run_* returns when it ends normally: a requested stop, or InstLimitReached
+    int take_requested_stop() {
+      const int reason = m_requested_stop;
+      m_requested_stop = StopReason::InstLimitReached;
+      return reason;
+    }
+
     // after run*() returns ExitSuccess or ExitFailure, this will return the
     // exit code from the running program (if run in a way that produces an
     // exit)
@@ -367,10 +796,22 @@ namespace udb {
 
     uint64_t num_insts_exec() const { return m_num_inst_exec; }
 
+    // the number of instructions retired
+    uint64_t num_insts_retired() const { return m_num_inst_exec - m_num_inst_trapped; }
+
+    // Called by the hart when mcountinhibit.IR or the Smcntrpmf minstretcfg filters change.
+    // inhibited_modes has bit (1 << PrivilegeMode::value()) set for every mode that doesn't count.
+    void set_instret_inhibit(bool inhibit_all, uint32_t inhibited_modes) {
+      m_instret_inhibit_all = inhibit_all;
+      m_instret_inhibit_modes = inhibited_modes;
+      update_instret_counting();
+    }
+
    protected:
     const unsigned m_hart_id;
     SocType& m_soc;
-    const Config m_cfg;
+    const std::shared_ptr<const Config> m_shared_cfg;
+    const Config& m_cfg;
     AbstractTracer* m_tracer;
     PrivilegeMode m_current_priv_mode;
 
@@ -378,10 +819,175 @@ namespace udb {
     std::string m_exit_reason;
 
     bool m_exit_requested;
+    int m_requested_stop = StopReason::InstLimitReached;  // see request_stop()
 
     // the number of instruction *executed*
     // THIS IS NOT minstret (some executed instructions do not retire)
     uint64_t m_num_inst_exec;
+
+    // executed instructions that raised an exception, and so did not retire
+    uint64_t m_num_inst_trapped = 0;
+
+    InstretCounter m_instret;
+    bool m_instret_inhibit_all = false;
+    uint32_t m_instret_inhibit_modes = 0;
+
+    void update_instret_counting() {
+      const bool counting = !m_instret_inhibit_all &&
+          ((m_instret_inhibit_modes & (1u << m_current_priv_mode.value())) == 0);
+      m_instret.set_counting(counting, num_insts_retired());
+    }
+
+    // optional translation cache shared between harts (nullptr if not attached)
+    std::shared_ptr<SharedBlockCache> m_shared_bb_cache;
+    unsigned m_shared_bb_reader = 0;
+
+    void note_store(uint64_t paddr, unsigned len) {
+      m_num_stores++;
+      m_jt_cache.note_store(paddr, len);
+      check_code_write(paddr, len);
+    }
+
+    // store fast path: drop cached code on the written page(s)
+    void check_code_write(uint64_t paddr, unsigned len) {
+      if (m_code_tracker) [[unlikely]] {
+        const uint64_t last = paddr + len - 1;
+        bool hit = note_code_write(paddr);
+        if (CodePageTracker::ppn(last) != CodePageTracker::ppn(paddr)) {
+          hit = note_code_write(last) || hit;
+        }
+        if (hit) {
+          sync_code_writes();
+        }
+      }
+    }
+
+    // note a store to a page that may hold code, and drop the page's shared blocks
+    bool note_code_write(uint64_t paddr) {
+      if (!m_code_tracker->maybe_code(paddr)) {
+        return false;
+      }
+      m_code_tracker->note_write(paddr);
+      if (m_shared_bb_cache) {
+        m_shared_bb_cache->invalidate_page(paddr);
+      }
+      return true;
+    }
+
+    // records the pages fetched from while in scope
+    class FetchPageRecorder {
+     public:
+      FetchPageRecorder(HartBase& hart, CodePages* pages) : m_hart(hart) {
+        m_hart.m_fetch_pages = m_hart.m_code_tracker ? pages : nullptr;
+        if (m_hart.m_fetch_pages != nullptr) {
+          pages->tracker = m_hart.m_code_tracker.get();
+        }
+      }
+      ~FetchPageRecorder() { m_hart.m_fetch_pages = nullptr; }
+
+     private:
+      HartBase& m_hart;
+    };
+
+    // fetch is being recorded for a block under construction
+    void note_fetch(uint64_t paddr) {
+      if (m_fetch_pages->add(CodePageTracker::ppn(paddr))) {
+        m_code_tracker->mark_code(paddr);
+      }
+    }
+
+    // loads made during one iteration of a candidate polling loop
+    struct WatchedLoads {
+      static constexpr unsigned MAX_LOADS = 16;  // enough for a 128-byte reservation set
+      struct Load {
+        uint64_t paddr;
+        unsigned bytes;
+        uint64_t value;
+      };
+
+      void clear() {
+        num = 0;
+        overflow = false;
+      }
+      void add(uint64_t paddr, unsigned bytes, uint64_t value) {
+        if (num == MAX_LOADS) {
+          overflow = true;
+        } else {
+          loads[num++] = {paddr, bytes, value};
+        }
+      }
+
+      std::array<Load, MAX_LOADS> loads;
+      unsigned num = 0;
+      bool overflow = false;
+    };
+
+    uint64_t read_watched(uint64_t paddr, unsigned bytes) {
+      switch (bytes) {
+        case 1: return m_soc.read_physical_memory_8(paddr);
+        case 2: return m_soc.read_physical_memory_16(paddr);
+        case 4: return m_soc.read_physical_memory_32(paddr);
+        default: return m_soc.read_physical_memory_64(paddr);
+      }
+    }
+
+    // optional timing model (nullptr if not attached)
+    const TimingModel* m_timing = nullptr;
+    uint64_t m_cycles_fx = 0;       // modeled cycles, in TimingModel fixed point
+    uint64_t m_mcycle_offset = 0;   // mcycle - cycles(), after software writes mcycle
+
+    HpmCounters m_hpm;
+
+    JumpTableCache m_jt_cache;  // resolved cm.jt/cm.jalt targets
+
+    // Trap entry state decoded from the delegation and trap vector CSRs, indexed by
+    // PrivilegeMode value. Rebuilt on first use after one of those CSRs is written.
+    struct TrapRouting {
+      bool valid = false;
+      std::array<uint64_t, 8> delegated_exceptions;  // to HS (medeleg) and VS (& hedeleg)
+      std::array<uint64_t, 8> delegated_interrupts;  // to S (mideleg) and VS (& hideleg)
+      std::array<uint64_t, 8> tvec_base;             // M, S, and VS
+      std::array<bool, 8> tvec_vectored;
+    };
+    TrapRouting m_trap_routing;
+
+    // Soft TLB tags for the current CSR state. The hart rebuilds them when one of the CSRs
+    // that translation depends on is written, and on first use after a reset.
+    struct TlbState {
+      bool valid = false;
+      uint64_t s_ctx = 0;    // satp and the status/envcfg bits an S-mode walk depends on
+      uint64_t vs_ctx = 0;   // vsatp, hgatp, and the bits a two-stage walk depends on
+      uint64_t g_ctx = 0;    // hgatp and the bits a G-stage walk depends on
+      uint16_t asid = 0;     // satp.ASID
+      uint16_t vs_asid = 0;  // vsatp.ASID
+      uint16_t vmid = 0;     // hgatp.VMID
+
+      bool operator==(const TlbState&) const = default;
+    };
+    TlbState m_tlb_state;
+
+    // Bumped whenever the virtual-to-physical mapping may have changed: on a write that
+    // changes a TlbState tag, and on a fence. Tags cached branch targets.
+    uint64_t m_translation_epoch = 0;
+
+    bool m_spin_detect = false;
+    uint64_t m_num_stores = 0;                // stores made by this hart
+    WatchedLoads m_spin_loads;                // what a spinning hart is polling
+    WatchedLoads* m_load_watch = nullptr;     // where to record loads, when watching
+
+    // optional store-to-code tracking (nullptr if not attached)
+    std::shared_ptr<CodePageTracker> m_code_tracker;
+    uint64_t m_code_seq = 0;        // last tracker sequence this hart has synced to
+    CodePages* m_fetch_pages = nullptr;  // where to record fetched pages, when building a block
+
+    // optional background translator (nullptr if not attached)
+    BackgroundTranslator* m_bg_translator = nullptr;
+    unsigned m_bg_producer = 0;
+
+   private:
+    unsigned m_soft_tlb_size = HartCacheConfig{}.soft_tlb_entries;
+    std::unique_ptr<SoftTlbEntry[]> m_soft_tlbs;
+    std::unique_ptr<SoftSuperpageTlb[]> m_superpage_tlbs;  // allocated with m_soft_tlbs
   };
 
 }  // namespace udb
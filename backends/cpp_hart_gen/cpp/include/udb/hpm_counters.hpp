@@ -0,0 +1,159 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "udb/defines.hpp"
+#include "udb/timing_model.hpp"
+
+namespace udb {
+
+  // mhpmevent selectors understood by the simulator
+  enum class HpmEvent : uint64_t {
+    None = 0,
+    InstRetired = 1,
+    Loads = 2,          // loads and atomics
+    Stores = 3,         // stores and atomics
+    TakenBranches = 4,  // conditional branches that were taken
+    Traps = 5,          // exceptions and interrupts taken
+    PageWalks = 6,      // address translations that walked the page table
+    FpOps = 7
+  };
+
+  // Event-backed mhpmcounter3-31.
+  //
+  // The hart keeps running totals of each event, updated in bulk once per basic block
+  // (instruction classes) or when the event happens (traps, page walks). A counter is
+  // never incremented itself; it remembers the offset between its value and the total
+  // of its event, so programming a counter costs nothing while the hart runs.
+  //
+  // Nothing is counted while no counter is programmed (see active()).
+  class HpmCounters {
+   public:
+    static constexpr unsigned FIRST_COUNTER = 3;
+    static constexpr unsigned LAST_COUNTER = 31;
+    static constexpr unsigned NUM_CLASSES = TimingModel::NUM_CLASSES;
+
+    using ClassCounts = std::array<uint8_t, NUM_CLASSES>;
+
+    HpmCounters() { reset(); }
+
+    void reset() {
+      m_class_totals.fill(0);
+      m_taken_branches = 0;
+      m_traps = 0;
+      m_page_walks = 0;
+      m_events.fill(HpmEvent::None);
+      m_offsets.fill(0);
+      m_frozen.fill(0);
+      m_inhibit = 0;
+      m_num_programmed = 0;
+    }
+
+    // true if any counter is selecting an event, i.e., the hart needs to count
+    bool active() const { return m_num_programmed != 0; }
+
+    bool programmed(unsigned n) const { return m_events[n] != HpmEvent::None; }
+    HpmEvent event(unsigned n) const { return m_events[n]; }
+
+    // event sources
+    void count_block(const ClassCounts& counts) {
+      for (unsigned i = 0; i < NUM_CLASSES; i++) {
+        m_class_totals[i] += counts[i];
+      }
+    }
+    void count_inst(InstClass c) { m_class_totals[static_cast<unsigned>(c)]++; }
+    void count_taken_branch() { m_taken_branches++; }
+    void count_trap() { m_traps++; }
+    void count_page_walk() { m_page_walks++; }
+
+    // current total of event e
+    uint64_t total(HpmEvent e) const {
+      switch (e) {
+        case HpmEvent::InstRetired: {
+          uint64_t sum = 0;
+          for (auto t : m_class_totals) {
+            sum += t;
+          }
+          return sum;
+        }
+        case HpmEvent::Loads:
+          return class_total(InstClass::Load) + class_total(InstClass::Atomic);
+        case HpmEvent::Stores:
+          return class_total(InstClass::Store) + class_total(InstClass::Atomic);
+        case HpmEvent::TakenBranches:
+          return m_taken_branches;
+        case HpmEvent::Traps:
+          return m_traps;
+        case HpmEvent::PageWalks:
+          return m_page_walks;
+        case HpmEvent::FpOps:
+          return class_total(InstClass::Fp) + class_total(InstClass::FpDiv);
+        default:
+          return 0;
+      }
+    }
+
+    // value of counter n
+    uint64_t read(unsigned n) const {
+      check_counter(n);
+      if (inhibited(n)) {
+        return m_frozen[n];
+      }
+      return total(m_events[n]) + m_offsets[n];
+    }
+
+    // set counter n to value
+    void write(unsigned n, uint64_t value) {
+      check_counter(n);
+      m_frozen[n] = value;
+      m_offsets[n] = value - total(m_events[n]);
+    }
+
+    // select the event counted by n, keeping the counter's value.
+    // Selectors the simulator doesn't know count nothing.
+    void program(unsigned n, uint64_t event) {
+      check_counter(n);
+      const uint64_t value = read(n);
+      const HpmEvent e = (event <= static_cast<uint64_t>(HpmEvent::FpOps)) ? static_cast<HpmEvent>(event) : HpmEvent::None;
+      if (programmed(n) != (e != HpmEvent::None)) {
+        m_num_programmed += (e != HpmEvent::None) ? 1 : -1;
+      }
+      m_events[n] = e;
+      write(n, value);
+    }
+
+    // mcountinhibit: counter n is stopped while bit n is set
+    void set_inhibit(uint32_t mask) {
+      for (unsigned n = FIRST_COUNTER; n <= LAST_COUNTER; n++) {
+        const uint32_t bit = 1u << n;
+        if ((m_inhibit ^ mask) & bit) {
+          const uint64_t value = read(n);
+          m_inhibit ^= bit;
+          write(n, value);
+        }
+      }
+    }
+    uint32_t inhibit() const { return m_inhibit; }
+
+   private:
+    static void check_counter(unsigned n) {
+      udb_assert(n >= FIRST_COUNTER && n <= LAST_COUNTER, "Not a programmable hpm counter");
+    }
+    bool inhibited(unsigned n) const { return (m_inhibit & (1u << n)) != 0; }
+    uint64_t class_total(InstClass c) const { return m_class_totals[static_cast<unsigned>(c)]; }
+
+    std::array<uint64_t, NUM_CLASSES> m_class_totals;
+    uint64_t m_taken_branches;
+    uint64_t m_traps;
+    uint64_t m_page_walks;
+
+    // indexed by counter number; 0-2 are unused
+    std::array<HpmEvent, LAST_COUNTER + 1> m_events;
+    std::array<uint64_t, LAST_COUNTER + 1> m_offsets;  // value - total(event)
+    std::array<uint64_t, LAST_COUNTER + 1> m_frozen;   // value while inhibited
+    uint32_t m_inhibit;
+    unsigned m_num_programmed;
+  };
+
+}  // namespace udb
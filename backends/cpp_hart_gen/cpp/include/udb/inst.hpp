@@ -125,6 +125,10 @@ namespace udb {
     // HartBase::SynchronousException will be raised in C++
     virtual void execute() = 0;
 
+    // index of the instruction in its config's instruction list. Together with
+    // the encoding, this is enough to rebuild the object without decoding
+    virtual unsigned kind() const = 0;
+
     virtual const std::string_view &name() = 0;
     virtual std::string disassemble(bool use_abi_reg_names = false) const = 0;
 
@@ -132,6 +136,10 @@ namespace udb {
     // i.e., is a branch
     virtual bool control_flow() const = 0;
 
+    // true if the instruction could read or set the pc, including by raising an
+    // exception. Blocks don't keep the hart's pc up to date for the others.
+    virtual bool uses_pc() const = 0;
+
     // return the
     virtual std::vector<Reg> srcRegs() const = 0;
     virtual std::vector<Reg> dstRegs() const = 0;
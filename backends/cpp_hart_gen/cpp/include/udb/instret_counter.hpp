@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+namespace udb {
+
+  // minstret, derived from the hart's retire count.
+  //
+  // minstret is never incremented itself. It is the number of instructions retired,
+  // less those retired while counting was inhibited, plus the offset left by software
+  // writes. Every call takes 'retired', the number of instructions the hart has retired
+  // so far, not counting the one executing.
+  class InstretCounter {
+   public:
+    InstretCounter() { reset(); }
+
+    void reset() {
+      m_offset = 0;
+      m_uncounted = 0;
+      m_stopped_at = 0;
+      m_counting = true;
+    }
+
+    uint64_t read(uint64_t retired) const { return counted(retired) + m_offset; }
+
+    // A software write by the executing instruction. That instruction retires after the
+    // write, and the next instruction must read exactly 'value', so its own retirement
+    // is taken out of the offset while counting.
+    void sw_write(uint64_t value, uint64_t retired) {
+      m_offset = value - counted(retired) - (m_counting ? 1 : 0);
+    }
+
+    bool counting() const { return m_counting; }
+
+    // start or stop counting. Only called when the inhibit settings or the mode
+    // change, never per instruction.
+    void set_counting(bool counting, uint64_t retired) {
+      if (counting == m_counting) {
+        return;
+      }
+      if (counting) {
+        m_uncounted += retired - m_stopped_at;
+      } else {
+        m_stopped_at = retired;
+      }
+      m_counting = counting;
+    }
+
+   private:
+    uint64_t counted(uint64_t retired) const {
+      return (m_counting ? retired : m_stopped_at) - m_uncounted;
+    }
+
+    uint64_t m_offset;      // minstret - counted(), after software writes
+    uint64_t m_uncounted;   // retired while inhibited, up to the last restart
+    uint64_t m_stopped_at;  // 'retired' when counting last stopped
+    bool m_counting;
+  };
+
+}  // namespace udb
@@ -2,8 +2,11 @@
 
 #include <fmt/core.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <limits>
 #include <vector>
 
 #include "udb/soc_model.hpp"
@@ -19,16 +22,19 @@ namespace udb {
       ~DenseMemory() = default;
 
       // subclasses only need to override these functions:
+      //
+      // Accesses may be misaligned (see read_memory in globals.isa), so multi-byte
+      // accesses go through memcpy, which the host turns into a single load or store.
       virtual uint64_t read(uint64_t addr, size_t bytes) {
         switch (bytes) {
           case 1:
             return m_data[addr - m_offset];
           case 2:
-            return *(uint16_t *)(addr + m_addend);
+            return load<uint16_t>(addr);
           case 4:
-            return *(uint32_t *)(addr + m_addend);
+            return load<uint32_t>(addr);
           case 8:
-            return *(uint64_t *)(addr + m_addend);
+            return load<uint64_t>(addr);
           default:
             __builtin_unreachable();
         }
@@ -40,13 +46,13 @@ namespace udb {
             m_data[addr - m_offset] = data;
             break;
           case 2:
-            *(uint16_t *)(addr + m_addend) = data;
+            store<uint16_t>(addr, data);
             break;
           case 4:
-            *(uint32_t *)(addr + m_addend) = data;
+            store<uint32_t>(addr, data);
             break;
           case 8:
-            *(uint64_t *)(addr + m_addend) = data;
+            store<uint64_t>(addr, data);
             break;
           default:
             __builtin_unreachable();
@@ -87,7 +93,40 @@ namespace udb {
         return size;
       }
 
+      // zero [addr, addr + bytes) with one host memset
+      // zero [addr, addr + bytes); the part outside of memory is ignored
+      void zero(uint64_t addr, size_t bytes) {
+        const uint64_t lo = std::max(addr, m_offset);
+        const uint64_t hi = std::min(addr + bytes, m_offset + m_data.size());
+        if (lo < hi) {
+          std::memset(lo + m_addend, 0, hi - lo);
+        }
+      }
+
+      // hint the host to cache the line holding addr; addresses outside of memory are ignored
+      void prefetch(uint64_t addr, bool for_write) const {
+        if ((addr - m_offset) < m_data.size()) {
+          if (for_write) {
+            __builtin_prefetch(addr + m_addend, 1);
+          } else {
+            __builtin_prefetch(addr + m_addend, 0);
+          }
+        }
+      }
+
      private:
+      template <typename T>
+      T load(uint64_t addr) const {
+        T value;
+        std::memcpy(&value, addr + m_addend, sizeof(T));
+        return value;
+      }
+      template <typename T>
+      void store(uint64_t addr, uint64_t data) {
+        const T value = static_cast<T>(data);
+        std::memcpy(addr + m_addend, &value, sizeof(T));
+      }
+
       std::vector<uint8_t> m_data;
       uint64_t m_offset;
       uint8_t *m_addend = nullptr;
@@ -99,11 +138,54 @@ namespace udb {
     IssSocModel() = delete;
     ~IssSocModel() = default;
 
+    // Simulated time.
+    //
+    // mtime is advanced by the ISS (one tick per instruction executed, or per
+    // timebase_ratio cycles with a timing model), and can be skipped forward when
+    // every hart is idle. Without a timing model, mcycle follows mtime.
+    uint64_t mtime() const { return m_mtime; }
+    void advance_time(uint64_t ticks) { m_mtime += ticks; }
+    void set_time(uint64_t mtime) { m_mtime = mtime; }
+
+    // A SiFive-style CLINT: msip at +0x0, mtimecmp at +0x4000, and mtime at +0xbff8
+    static constexpr uint64_t CLINT_SIZE = 0xc000;
+    void add_clint(uint64_t base_addr, unsigned num_harts) {
+      m_clint_base = base_addr;
+      m_has_clint = true;
+      m_msip.assign(num_harts, 0);
+      m_mtimecmp.assign(num_harts, std::numeric_limits<uint64_t>::max());
+    }
+    bool msip(unsigned hart_id) const { return m_has_clint && (m_msip[hart_id] & 1); }
+    bool mtip(unsigned hart_id) const { return m_has_clint && (m_mtime >= m_mtimecmp[hart_id]); }
+
+    // earliest future time at which some hart's timer interrupt will become pending,
+    // or UINT64_MAX if there is none
+    uint64_t next_timer_deadline() const {
+      uint64_t deadline = std::numeric_limits<uint64_t>::max();
+      for (auto cmp : m_mtimecmp) {
+        if (cmp > m_mtime && cmp < deadline) {
+          deadline = cmp;
+        }
+      }
+      return deadline;
+    }
+
     uint64_t read_hpm_counter(uint64_t n) { return 0; }
-    uint64_t read_mcycle() { return 0; }
-    uint64_t read_mtime() { return 0; }
-    uint64_t sw_write_mcycle(uint64_t value) { return value; }
-    void cache_block_zero(uint64_t cache_block_physical_address) {}
+    uint64_t read_mcycle() { return m_mtime + m_mcycle_offset; }
+    uint64_t read_mtime() { return m_mtime; }
+    uint64_t sw_write_mcycle(uint64_t value) {
+      m_mcycle_offset = value - m_mtime;
+      return value;
+    }
+    void cache_block_zero(uint64_t cache_block_physical_address, uint64_t size) {
+      if (is_clint(cache_block_physical_address)) [[unlikely]] {
+        for (uint64_t offset = 0; offset < size; offset += 8) {
+          clint_write(cache_block_physical_address + offset, 0, 8);
+        }
+      } else {
+        m_memory.zero(cache_block_physical_address, size);
+      }
+    }
     void eei_ecall_from_m() {}
     void eei_ecall_from_s() {}
     void eei_ecall_from_u() {}
@@ -113,9 +195,11 @@ namespace udb {
     void memory_model_release() {}
     void assert(uint8_t test, const char *message) {}
     void notify_mode_change(PrivilegeMode new_mode, PrivilegeMode old_mode) {}
-    void prefetch_instruction(uint64_t virtual_address) {}
-    void prefetch_read(uint64_t virtual_address) {}
-    void prefetch_write(uint64_t virtual_address) {}
+    // Prefetches are hints, so the address is used as-is: it is the right host line
+    // when translation is off, and a harmless miss otherwise.
+    void prefetch_instruction(uint64_t virtual_address) { m_memory.prefetch(virtual_address, false); }
+    void prefetch_read(uint64_t virtual_address) { m_memory.prefetch(virtual_address, false); }
+    void prefetch_write(uint64_t virtual_address) { m_memory.prefetch(virtual_address, true); }
     void fence(uint8_t pi, uint8_t pr, uint8_t po, uint8_t pw, uint8_t si,
                uint8_t sr, uint8_t so, uint8_t sw) {}
     void fence_tso() {}
@@ -124,28 +208,56 @@ namespace udb {
     void order_pgtbl_reads_after_vmafence() {}
 
     uint64_t read_physical_memory_8(uint64_t paddr) {
+      if (is_clint(paddr)) [[unlikely]] {
+        return clint_read(paddr, 1);
+      }
       return m_memory.read(paddr, 1);
     }
     uint64_t read_physical_memory_16(uint64_t paddr) {
+      if (is_clint(paddr)) [[unlikely]] {
+        return clint_read(paddr, 2);
+      }
       return m_memory.read(paddr, 2);
     }
     uint64_t read_physical_memory_32(uint64_t paddr) {
+      if (is_clint(paddr)) [[unlikely]] {
+        return clint_read(paddr, 4);
+      }
       return m_memory.read(paddr, 4);
     }
     uint64_t read_physical_memory_64(uint64_t paddr) {
+      if (is_clint(paddr)) [[unlikely]] {
+        return clint_read(paddr, 8);
+      }
       return m_memory.read(paddr, 8);
     }
     void write_physical_memory_8(uint64_t paddr, uint64_t value) {
-      m_memory.write(paddr, value, 1);
+      if (is_clint(paddr)) [[unlikely]] {
+        clint_write(paddr, value, 1);
+      } else {
+        m_memory.write(paddr, value, 1);
+      }
     }
     void write_physical_memory_16(uint64_t paddr, uint64_t value) {
-      m_memory.write(paddr, value, 2);
+      if (is_clint(paddr)) [[unlikely]] {
+        clint_write(paddr, value, 2);
+      } else {
+        m_memory.write(paddr, value, 2);
+      }
     }
     void write_physical_memory_32(uint64_t paddr, uint64_t value) {
-      m_memory.write(paddr, value, 4);
+      if (is_clint(paddr)) [[unlikely]] {
+        clint_write(paddr, value, 4);
+      } else {
+        m_memory.write(paddr, value, 4);
+      }
     }
     void write_physical_memory_64(uint64_t paddr, uint64_t value) {
-      m_memory.write(paddr, value, 8);
+      if (is_clint(paddr)) [[unlikely]] {
+        clint_write(paddr, value, 8);
+      } else {
+        m_memory.write(paddr, value, 8);
+      }
     }
 
     int memcpy_from_host(uint64_t guest_paddr, const uint8_t *host_ptr,
@@ -295,8 +407,21 @@ namespace udb {
       }
     }
 
+    // Everything but the CLINT is main memory, and every other attribute applies everywhere.
+    // len is in bits.
     uint8_t pma_applies_Q_(PmaAttribute attr, uint64_t paddr, uint32_t len) {
-      return true;
+      const uint64_t bytes = (len + 7) / 8;
+      switch (attr.value()) {
+        case PmaAttribute::MainMemory:
+        case PmaAttribute::Cacheable:
+        case PmaAttribute::Coherent:
+        case PmaAttribute::Idempotent:
+          return !overlaps_clint(paddr, bytes);
+        case PmaAttribute::IO:
+          return is_clint(paddr) && is_clint(paddr + bytes - 1);
+        default:
+          return true;
+      }
     }
 
 
@@ -315,7 +440,69 @@ namespace udb {
     void sync_write_after_read_device(bool, uint32_t) {}
 
    private:
+    static constexpr uint64_t CLINT_MTIMECMP = 0x4000;
+    static constexpr uint64_t CLINT_MTIME = 0xbff8;
+
+    bool is_clint(uint64_t paddr) const {
+      return m_has_clint && ((paddr - m_clint_base) < CLINT_SIZE);
+    }
+    bool overlaps_clint(uint64_t paddr, uint64_t bytes) const {
+      return m_has_clint && (paddr < m_clint_base + CLINT_SIZE) && (m_clint_base < paddr + bytes);
+    }
+
+    // reads/writes narrower than a register access part of it
+    static uint64_t extract(uint64_t reg, uint64_t offset, size_t bytes) {
+      const unsigned shift = (offset & 7) * 8;
+      return (bytes == 8) ? reg : ((reg >> shift) & ((1ull << (bytes * 8)) - 1));
+    }
+    static uint64_t insert(uint64_t reg, uint64_t offset, uint64_t value, size_t bytes) {
+      if (bytes == 8) {
+        return value;
+      }
+      const unsigned shift = (offset & 7) * 8;
+      const uint64_t mask = ((1ull << (bytes * 8)) - 1) << shift;
+      return (reg & ~mask) | ((value << shift) & mask);
+    }
+
+    uint64_t clint_read(uint64_t paddr, size_t bytes) const {
+      const uint64_t offset = paddr - m_clint_base;
+      if (offset < CLINT_MTIMECMP) {
+        const uint64_t hart = offset / 4;
+        return (hart < m_msip.size()) ? (m_msip[hart] & 1) : 0;
+      } else if (offset >= CLINT_MTIME) {
+        return extract(m_mtime, offset, bytes);
+      } else {
+        const uint64_t hart = (offset - CLINT_MTIMECMP) / 8;
+        return (hart < m_mtimecmp.size()) ? extract(m_mtimecmp[hart], offset, bytes) : 0;
+      }
+    }
+
+    void clint_write(uint64_t paddr, uint64_t value, size_t bytes) {
+      const uint64_t offset = paddr - m_clint_base;
+      if (offset < CLINT_MTIMECMP) {
+        const uint64_t hart = offset / 4;
+        if (hart < m_msip.size()) {
+          m_msip[hart] = value & 1;
+        }
+      } else if (offset >= CLINT_MTIME) {
+        m_mtime = insert(m_mtime, offset, value, bytes);
+      } else {
+        const uint64_t hart = (offset - CLINT_MTIMECMP) / 8;
+        if (hart < m_mtimecmp.size()) {
+          m_mtimecmp[hart] = insert(m_mtimecmp[hart], offset, value, bytes);
+        }
+      }
+    }
+
     DenseMemory m_memory;
+
+    uint64_t m_mtime = 0;
+    uint64_t m_mcycle_offset = 0;
+
+    bool m_has_clint = false;
+    uint64_t m_clint_base = 0;
+    std::vector<uint32_t> m_msip;
+    std::vector<uint64_t> m_mtimecmp;
   };
 
   static_assert(SocModel<IssSocModel>,
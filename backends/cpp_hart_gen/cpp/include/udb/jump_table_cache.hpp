@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace udb {
+
+  // Resolved Zcmt jump table entries (cm.jt / cm.jalt targets), indexed by the
+  // instruction's 8-bit table index.
+  //
+  // Every entry was filled under one context (the hart's translation context); a
+  // lookup under any other context misses, and the first fill under a new context
+  // drops the old entries. The hart invalidates the cache when jvt or the PMP
+  // changes, on sfence.vma and fence.i, and when it stores to the physical range
+  // the cached entries were read from.
+  class JumpTableCache {
+   public:
+    static constexpr unsigned NUM_ENTRIES = 256;
+
+    JumpTableCache() { invalidate(); }
+
+    bool lookup(uint64_t ctx, unsigned index, uint64_t& target) const {
+      if (ctx != m_ctx || !m_valid[index]) {
+        return false;
+      }
+      target = m_targets[index];
+      return true;
+    }
+
+    // entry index, read from [entry_paddr, entry_paddr + bytes), resolved to target under ctx
+    void fill(uint64_t ctx, unsigned index, uint64_t entry_paddr, unsigned bytes, uint64_t target) {
+      if (ctx != m_ctx) {
+        invalidate();
+        m_ctx = ctx;
+      }
+      m_valid[index] = true;
+      m_targets[index] = target;
+      if (entry_paddr < m_lo) {
+        m_lo = entry_paddr;
+      }
+      if (entry_paddr + bytes - 1 > m_hi) {
+        m_hi = entry_paddr + bytes - 1;
+      }
+    }
+
+    void invalidate() {
+      m_valid.fill(false);
+      m_ctx = 0;
+      m_lo = std::numeric_limits<uint64_t>::max();
+      m_hi = 0;
+    }
+
+    // a store to [paddr, paddr + len); drops everything if it may have written an entry.
+    // The range check fails right away while nothing is cached.
+    void note_store(uint64_t paddr, unsigned len) {
+      if (paddr <= m_hi && paddr + len - 1 >= m_lo) [[unlikely]] {
+        invalidate();
+      }
+    }
+
+    // true if nothing is cached
+    bool empty() const { return m_lo > m_hi; }
+
+   private:
+    uint64_t m_ctx;
+    uint64_t m_lo;  // lowest physical address read by a cached entry
+    uint64_t m_hi;  // highest physical address read by a cached entry
+    std::array<bool, NUM_ENTRIES> m_valid;
+    std::array<uint64_t, NUM_ENTRIES> m_targets{};
+  };
+
+}  // namespace udb
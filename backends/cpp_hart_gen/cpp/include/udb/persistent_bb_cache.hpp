@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <span>
+
+#include "udb/shared_bb_cache.hpp"
+
+namespace udb {
+
+  // On-disk store of basic-block layouts, so repeated runs of the same binary
+  // don't have to decode the same code again.
+  //
+  // Layouts are saved per physical page of code. A page's file is keyed by
+  // (config, generator, hash of the page's contents), so a file can only ever
+  // be applied to a byte-identical page, wherever that page is loaded. Only
+  // blocks whose physical address is known (see SharedBlockRecord::paddr) and
+  // which fit inside one page are saved.
+  //
+  // The directory is kept under a size limit by deleting the least recently
+  // used files.
+  class PersistentBlockCache {
+   public:
+    static constexpr uint64_t PAGE_SIZE = 4096;
+
+    // bump whenever the file format or the meaning of a layout changes
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    // copy the PAGE_SIZE bytes at page-aligned physical address paddr into buf.
+    // Returns false if the page isn't backed by memory.
+    using ReadPageFn = std::function<bool(uint64_t paddr, std::span<uint8_t, PAGE_SIZE> buf)>;
+
+    // called with the page-aligned physical address of each page load() published blocks on
+    using LoadedPageFn = std::function<void(uint64_t paddr)>;
+
+    // config_hash identifies the config; decode_signature identifies the
+    // generated decoder (see HartBase::decode_signature)
+    PersistentBlockCache(const std::filesystem::path& dir, uint64_t config_hash,
+                         uint64_t decode_signature, uint64_t max_bytes);
+
+    // publish every saved block for pages in [base, base + size) whose contents
+    // match, and report each page that got any to on_page (so it can be watched for
+    // writes). Returns the number of blocks published.
+    size_t load(SharedBlockCache& cache, uint64_t base, uint64_t size, const ReadPageFn& read_page,
+                const LoadedPageFn& on_page = nullptr);
+
+    // save all blocks from the cache with a known physical address, then trim
+    // the directory to the size limit. Returns the number of blocks saved.
+    size_t save(SharedBlockCache& cache, const ReadPageFn& read_page);
+
+    static uint64_t hash_bytes(const uint8_t* data, size_t len, uint64_t seed = 0);
+
+   private:
+    std::filesystem::path page_file(uint64_t content_hash) const;
+    void enforce_limit();
+
+    const std::filesystem::path m_dir;
+    const uint64_t m_config_hash;
+    const uint64_t m_decode_signature;
+    const uint64_t m_max_bytes;
+  };
+
+}  // namespace udb
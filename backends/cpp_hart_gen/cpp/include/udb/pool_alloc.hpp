@@ -1,86 +1,208 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <concepts>
+#include <cstddef>
 #include <cstdint>
-#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
 
 #include "udb/defines.hpp"
 
 namespace udb {
-  // simple memory pool allocator
+  // Thread-safe pool of fixed-size objects.
+  //
+  // Objects are carved from chunks of PoolSize objects. Chunks are aligned to their
+  // (power-of-two) size and start with a pointer to the pool's depot, so the pool an
+  // object belongs to can be found from its address alone (see release). An object is
+  // only ever reused by the pool it came from, so every object in a pool is of that
+  // pool's size class.
+  //
+  // Each thread keeps a magazine of up to MAGAZINE_SIZE free objects for each of up to
+  // NUM_MAGAZINES pools of a type, and allocates from and frees to it without locking.
+  // An empty magazine is refilled from the shared depot, and a full one hands half of
+  // its objects back, under the depot's lock. Pools of a type are numbered, and a
+  // thread only rebinds (and locks) a magazine when two pools it uses share a number
+  // modulo NUM_MAGAZINES.
+  //
+  // reset() returns every object of the pool at once, in O(1): the depot moves to a
+  // new generation and carves its chunks again from the start, and magazines filled
+  // under an earlier generation are dropped the next time they are used. Every slot
+  // records the generation it was allocated in, and clears it when freed. Freeing an
+  // object allocated before a reset (or freeing one twice) is a bug in the caller; it
+  // is dropped as long as its slot hasn't been handed out again since.
 
   template <typename Klass>
   concept PoolAllocatable = (sizeof(Klass) >= sizeof(Klass*));
 
-  struct PoolObj {
-    void* m_next;
-  };
-
   template <PoolAllocatable BaseObjType, unsigned ObjSize,
             unsigned PoolSize =
                 200 /* Number of elements to grow the pool by on a resize */>
   class PoolAllocator {
    public:
-    PoolAllocator()
-        : m_freelist_head(nullptr)
-#ifndef NDEBUG
-          ,
-          m_total_obj_created(0),
-          m_allocated_objs(0)
-#endif
-    {
+    static constexpr unsigned MAGAZINE_SIZE = 32;
+    static constexpr unsigned NUM_MAGAZINES = 16;
+
+    // the generation stamp in front of every object, padded to keep the object aligned
+    static constexpr size_t HEADER_SIZE = alignof(std::max_align_t);
+    static_assert(HEADER_SIZE >= sizeof(uint64_t));
+
+    // bytes per object and its header, rounded up so that every object is suitably aligned
+    static constexpr size_t SLOT_SIZE =
+        HEADER_SIZE +
+        (ObjSize + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+    static constexpr size_t CHUNK_BYTES = std::bit_ceil(SLOT_SIZE * (PoolSize + 1));
+
+    PoolAllocator() : m_depot(std::make_shared<Depot>()) {}
+
+    PoolAllocator(const PoolAllocator&) = delete;
+    PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+    BaseObjType* allocate() noexcept {
+      Magazine& mag = magazine(m_depot.get());
+      if (mag.count == 0) [[unlikely]] {
+        m_depot->refill(mag);
+      }
+      void* obj = mag.objs[--mag.count];
+      stamp(obj) = mag.generation;
+      return static_cast<BaseObjType*>(obj);
     }
 
-    ~PoolAllocator() {
-      // fprintf(stderr,
-      //         "Warning: The pool allocator does not free memory "
-      //         "on deconstruction. You probably shouldn't delete it.\n");
+    void free(BaseObjType* del) noexcept { release(del); }
+
+    // return an object from any pool of this type to its own pool
+    static void release(void* del) noexcept {
+      Depot* depot = chunk_depot(del);
+      Magazine& mag = magazine(depot);
+      if (stamp(del) != mag.generation) [[unlikely]] {
+        // allocated before the last reset, or already freed
+        return;
+      }
+      stamp(del) = 0;
+      if (mag.count == MAGAZINE_SIZE) [[unlikely]] {
+        depot->flush(mag, MAGAZINE_SIZE / 2);
+      }
+      mag.objs[mag.count++] = del;
     }
 
-    // allocate a single object with a custom size
-    BaseObjType* allocate() noexcept {
-      if (m_freelist_head == nullptr) {
-        // need more objects
-
-        m_freelist_head = (BaseObjType*)new char[PoolSize * ObjSize];
-
-        for (unsigned i = 0; i < PoolSize; i++) {
-          if (i == PoolSize - 1) {
-            reinterpret_cast<PoolObj*>(&m_freelist_head[i])->m_next = nullptr;
-          } else {
-            reinterpret_cast<PoolObj*>(&m_freelist_head[i])->m_next =
-                reinterpret_cast<BaseObjType*>(&m_freelist_head[i + 1]);
-          }
+    // drop every object allocated from this pool
+    void reset() noexcept { m_depot->reset(); }
+
+    // bytes of chunk storage held by the pool
+    size_t memory_footprint() const { return m_depot->num_chunks() * CHUNK_BYTES; }
+
+   private:
+    struct Depot;
+
+    struct Magazine {
+      std::shared_ptr<Depot> depot;  // keeps the depot alive while this thread holds its objects
+      uint64_t generation = 0;
+      unsigned count = 0;
+      void* objs[MAGAZINE_SIZE];
+
+      ~Magazine() {
+        if (depot) {
+          depot->flush(*this, count);
         }
-#ifndef NDEBUG
-        m_total_obj_created += PoolSize;
-#endif
       }
-      BaseObjType* ret = m_freelist_head;
-      m_freelist_head = reinterpret_cast<BaseObjType*>(
-          reinterpret_cast<PoolObj*>(ret)->m_next);
-#ifndef NDEBUG
-      m_allocated_objs++;
-#endif
-      return ret;
+    };
+
+    struct Depot : std::enable_shared_from_this<Depot> {
+      static inline std::atomic<unsigned> next_id{0};
+
+      const unsigned id = next_id.fetch_add(1, std::memory_order_relaxed);
+      std::mutex lock;
+      std::atomic<uint64_t> generation{1};  // 0 marks a free slot
+      std::vector<void*> free_objs;
+      std::vector<void*> chunks;
+      size_t next_chunk = 0;  // chunk being carved
+      size_t next_slot = 0;   // next uncarved object in it
+
+      ~Depot() {
+        for (void* chunk : chunks) {
+          ::operator delete(chunk, std::align_val_t{CHUNK_BYTES});
+        }
+      }
+
+      size_t num_chunks() {
+        std::lock_guard<std::mutex> guard(lock);
+        return chunks.size();
+      }
+
+      // top up an empty magazine to half full, most recently freed objects on top
+      void refill(Magazine& mag) {
+        std::lock_guard<std::mutex> guard(lock);
+        const size_t reused = std::min<size_t>(free_objs.size(), MAGAZINE_SIZE / 2);
+        while (mag.count < MAGAZINE_SIZE / 2 - reused) {
+          mag.objs[mag.count++] = carve();
+        }
+        for (size_t i = free_objs.size() - reused; i < free_objs.size(); i++) {
+          mag.objs[mag.count++] = free_objs[i];
+        }
+        free_objs.resize(free_objs.size() - reused);
+      }
+
+      // give n objects from the top of the magazine back
+      void flush(Magazine& mag, unsigned n) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (mag.generation == generation.load(std::memory_order_relaxed)) {
+          free_objs.insert(free_objs.end(), &mag.objs[mag.count - n], &mag.objs[mag.count]);
+        }
+        mag.count -= n;
+      }
+
+      void reset() {
+        std::lock_guard<std::mutex> guard(lock);
+        generation.fetch_add(1, std::memory_order_relaxed);
+        free_objs.clear();
+        next_chunk = 0;
+        next_slot = 0;
+      }
+
+      void* carve() {
+        if (next_chunk < chunks.size() && next_slot == PoolSize) {
+          next_chunk++;
+          next_slot = 0;
+        }
+        if (next_chunk == chunks.size()) {
+          void* chunk = ::operator new(CHUNK_BYTES, std::align_val_t{CHUNK_BYTES});
+          *static_cast<Depot**>(chunk) = this;
+          chunks.push_back(chunk);
+        }
+        // slot 0 holds the depot pointer
+        return static_cast<char*>(chunks[next_chunk]) + SLOT_SIZE * (1 + next_slot++) + HEADER_SIZE;
+      }
+    };
+
+    static uint64_t& stamp(void* obj) {
+      return *reinterpret_cast<uint64_t*>(static_cast<char*>(obj) - HEADER_SIZE);
     }
 
-    void free(BaseObjType* del) noexcept {
-      reinterpret_cast<PoolObj*>(del)->m_next = m_freelist_head;
-      m_freelist_head = del;
-#ifndef NDEBUG
-      // check against double free
-      udb_assert(m_allocated_objs > 0, "double free");
-      m_allocated_objs--;
-#endif
+    static Depot* chunk_depot(void* obj) {
+      return *reinterpret_cast<Depot**>(reinterpret_cast<uintptr_t>(obj) & ~(CHUNK_BYTES - 1));
     }
 
-   private:
-    BaseObjType* m_freelist_head;
+    // this thread's magazine for depot, bound to its current generation
+    static Magazine& magazine(Depot* depot) {
+      static thread_local std::array<Magazine, NUM_MAGAZINES> t_mags;
+      Magazine& mag = t_mags[depot->id % NUM_MAGAZINES];
+      const uint64_t generation = depot->generation.load(std::memory_order_relaxed);
+      if (mag.depot.get() != depot || mag.generation != generation) [[unlikely]] {
+        if (mag.depot) {
+          // another pool, or an earlier generation, whose objects are simply dropped
+          mag.depot->flush(mag, mag.count);
+        }
+        mag.depot = depot->shared_from_this();
+        mag.generation = generation;
+      }
+      return mag;
+    }
 
-#ifndef NDEBUG
-    uint64_t m_total_obj_created;
-    uint64_t m_allocated_objs;
-#endif
+    std::shared_ptr<Depot> m_depot;
   };
 }  // namespace udb
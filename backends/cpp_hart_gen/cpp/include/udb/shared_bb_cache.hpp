@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "udb/defines.hpp"
+
+namespace udb {
+
+  // Decoded layout of a basic block: the encoding and instruction kind of each
+  // instruction, in order.
+  //
+  // Instruction objects are bound to the hart that owns them, so they can't be
+  // shared. The layout is enough for any hart of the same config to rebuild the
+  // block without fetching or decoding.
+  //
+  // Records are immutable once published.
+  struct SharedBlockRecord {
+    static constexpr unsigned MAX_INSTS = 40;
+    static constexpr uint64_t UNKNOWN_PADDR = ~static_cast<uint64_t>(0);
+
+    struct Entry {
+      uint64_t encoding;
+      uint32_t kind;
+    };
+
+    uint64_t pc;
+    uint64_t paddr;       // physical address of pc, or UNKNOWN_PADDR
+    uint64_t ctx;         // translation context (mode, xlen, satp, ...) the block was decoded in
+    uint64_t generation;  // generation(paddr) before the code was read
+    unsigned num_insts;
+    std::array<Entry, MAX_INSTS> insts;
+  };
+
+  // Translation cache shared by all harts of one config.
+  //
+  // The table is direct-mapped on (pc, ctx). Each slot holds a pointer to an
+  // immutable SharedBlockRecord:
+  //
+  //   * lookups are lock-free: a reader announces the epoch it is reading in,
+  //     loads the slot, and copies what it needs before leaving
+  //   * publishing swaps the slot pointer and retires the old record; retired
+  //     records are freed once every reader has moved past the retire epoch
+  //   * invalidate() bumps a generation counter, so any hart can drop the whole
+  //     cache in O(1), and invalidate_page() bumps the counter of one page (hashed),
+  //     dropping only the blocks there. A record is current while the sum of the two
+  //     counters for its page is what it was before its code was read. Stale records stay in
+  //     place until they are replaced. Records with an unknown physical address are
+  //     only dropped by invalidate(); users check them against memory (see
+  //     _fill_bb_from_shared)
+  //
+  // Each hart using the cache must register as a reader first.
+  class SharedBlockCache {
+   public:
+    static constexpr unsigned MAX_READERS = 256;
+    static constexpr unsigned DEFAULT_NUM_SLOTS = 16384;
+    static constexpr unsigned NUM_PAGE_GENERATIONS = 4096;
+    static constexpr unsigned PAGE_SHIFT = 12;
+
+    struct Stats {
+      uint64_t hits;
+      uint64_t misses;
+      uint64_t publishes;
+      uint64_t invalidations;
+      uint64_t stale_publishes;  // publishes dropped because the code changed under them
+    };
+
+    SharedBlockCache(const std::string& config_name, unsigned num_slots = DEFAULT_NUM_SLOTS)
+      : m_config_name(config_name),
+        m_num_slots(num_slots),
+        m_slots(std::make_unique<std::atomic<const SharedBlockRecord*>[]>(num_slots)),
+        m_generation(0),
+        m_global_epoch(1),
+        m_num_readers(0)
+    {
+      udb_assert((num_slots != 0) && (__builtin_popcount(num_slots) == 1),
+                 "Number of shared cache slots must be a power of two");
+      for (unsigned i = 0; i < m_num_slots; i++) {
+        m_slots[i].store(nullptr, std::memory_order_relaxed);
+      }
+      for (auto& r : m_readers) {
+        r.epoch.store(IDLE, std::memory_order_relaxed);
+      }
+      for (auto& g : m_page_generations) {
+        g.store(0, std::memory_order_relaxed);
+      }
+    }
+
+    SharedBlockCache(const SharedBlockCache&) = delete;
+    SharedBlockCache& operator=(const SharedBlockCache&) = delete;
+
+    ~SharedBlockCache() {
+      for (unsigned i = 0; i < m_num_slots; i++) {
+        delete m_slots[i].load(std::memory_order_relaxed);
+      }
+      for (auto& r : m_retired) {
+        delete r.record;
+      }
+    }
+
+    const std::string& config_name() const { return m_config_name; }
+
+    // returns an id to pass to ReadGuard
+    unsigned register_reader() {
+      unsigned id = m_num_readers.fetch_add(1, std::memory_order_relaxed);
+      udb_assert(id < MAX_READERS, "Too many harts attached to a shared block cache");
+      return id;
+    }
+
+    // read-side critical section. Records returned by lookup() stay valid
+    // until the guard goes out of scope.
+    class ReadGuard {
+     public:
+      ReadGuard(SharedBlockCache& cache, unsigned reader_id)
+        : m_slot(cache.m_readers[reader_id].epoch)
+      {
+        m_slot.store(cache.m_global_epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+        // pairs with the fence in reclaim(): either reclaim() sees this epoch, or
+        // our slot loads see any record swap that preceded the reclaim
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+      }
+      ~ReadGuard() { m_slot.store(IDLE, std::memory_order_release); }
+
+     private:
+      std::atomic<uint64_t>& m_slot;
+    };
+
+    // returns nullptr on a miss. Must be called under a ReadGuard.
+    const SharedBlockRecord* lookup(uint64_t pc, uint64_t ctx) {
+      const SharedBlockRecord* rec = m_slots[index(pc, ctx)].load(std::memory_order_acquire);
+      if (rec != nullptr && rec->pc == pc && rec->ctx == ctx &&
+          rec->generation == generation(rec->paddr)) {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return rec;
+      }
+      m_misses.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    // publish a block layout. The record is copied.
+    //
+    // gen is generation(layout.paddr) as read *before* the block's code was read. If
+    // the code was written since, the layout may be stale; it is dropped and false
+    // is returned.
+    bool publish(const SharedBlockRecord& layout, uint64_t gen) {
+      udb_assert(layout.num_insts <= SharedBlockRecord::MAX_INSTS, "Block too large");
+      if (generation(layout.paddr) != gen) {
+        m_stale_publishes.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      auto* rec = new SharedBlockRecord(layout);
+      rec->generation = gen;
+      const SharedBlockRecord* old =
+        m_slots[index(rec->pc, rec->ctx)].exchange(rec, std::memory_order_acq_rel);
+      m_publishes.fetch_add(1, std::memory_order_relaxed);
+      if (old != nullptr) {
+        retire(old);
+      }
+      return true;
+    }
+
+    // drop every cached layout. Safe to call from any hart at any time.
+    void invalidate() {
+      m_generation.fetch_add(1, std::memory_order_acq_rel);
+      m_invalidations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // drop every cached layout on the physical page holding paddr (and on the pages that
+    // share its counter). Safe to call from any hart at any time.
+    void invalidate_page(uint64_t paddr) {
+      m_page_generations[page_index(paddr)].fetch_add(1, std::memory_order_acq_rel);
+      m_invalidations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // generation of blocks starting at physical address paddr (or UNKNOWN_PADDR)
+    uint64_t generation(uint64_t paddr) const {
+      uint64_t gen = m_generation.load(std::memory_order_acquire);
+      if (paddr != SharedBlockRecord::UNKNOWN_PADDR) {
+        gen += m_page_generations[page_index(paddr)].load(std::memory_order_acquire);
+      }
+      return gen;
+    }
+
+    // call fn(const SharedBlockRecord&) for every current (not invalidated) record.
+    // Must be called under a ReadGuard.
+    template <typename Fn>
+    void for_each(Fn&& fn) const {
+      for (unsigned i = 0; i < m_num_slots; i++) {
+        const SharedBlockRecord* rec = m_slots[i].load(std::memory_order_acquire);
+        if (rec != nullptr && rec->generation == generation(rec->paddr)) {
+          fn(*rec);
+        }
+      }
+    }
+
+    Stats stats() const {
+      return {
+        m_hits.load(std::memory_order_relaxed),
+        m_misses.load(std::memory_order_relaxed),
+        m_publishes.load(std::memory_order_relaxed),
+        m_invalidations.load(std::memory_order_relaxed),
+        m_stale_publishes.load(std::memory_order_relaxed)
+      };
+    }
+
+    // bytes of host memory held by the cache (slots plus live records, approximate)
+    size_t memory_footprint() const {
+      size_t size = m_num_slots * sizeof(std::atomic<const SharedBlockRecord*>);
+      for (unsigned i = 0; i < m_num_slots; i++) {
+        if (m_slots[i].load(std::memory_order_relaxed) != nullptr) {
+          size += sizeof(SharedBlockRecord);
+        }
+      }
+      return size;
+    }
+
+   private:
+    static constexpr uint64_t IDLE = ~static_cast<uint64_t>(0);
+
+    // retired records are reclaimed in batches of this size
+    static constexpr size_t RECLAIM_THRESHOLD = 64;
+
+    struct alignas(64) ReaderSlot {
+      std::atomic<uint64_t> epoch;
+    };
+
+    struct Retired {
+      const SharedBlockRecord* record;
+      uint64_t epoch;
+    };
+
+    unsigned index(uint64_t pc, uint64_t ctx) const {
+      // multiplicative hash; the high bits of the product depend on all input bits
+      uint64_t h = ((pc >> 1) ^ (ctx * 0xff51afd7ed558ccdull)) * 0x9e3779b97f4a7c15ull;
+      return (h >> 32) & (m_num_slots - 1);
+    }
+
+    static unsigned page_index(uint64_t paddr) {
+      const uint64_t ppn = paddr >> PAGE_SHIFT;
+      return (ppn ^ (ppn >> 12) ^ (ppn >> 24)) & (NUM_PAGE_GENERATIONS - 1);
+    }
+
+    void retire(const SharedBlockRecord* rec) {
+      std::lock_guard<std::mutex> lock(m_retire_mutex);
+      // any reader that could still see rec entered at or before this epoch
+      uint64_t epoch = m_global_epoch.fetch_add(1, std::memory_order_acq_rel);
+      m_retired.push_back({rec, epoch});
+      if (m_retired.size() >= RECLAIM_THRESHOLD) {
+        reclaim();
+      }
+    }
+
+    // caller holds m_retire_mutex
+    void reclaim() {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      uint64_t oldest = IDLE;
+      unsigned num_readers = std::min(m_num_readers.load(std::memory_order_acquire), MAX_READERS);
+      for (unsigned i = 0; i < num_readers; i++) {
+        uint64_t e = m_readers[i].epoch.load(std::memory_order_seq_cst);
+        if (e < oldest) {
+          oldest = e;
+        }
+      }
+      auto keep = m_retired.begin();
+      for (auto it = m_retired.begin(); it != m_retired.end(); ++it) {
+        if (it->epoch < oldest) {
+          delete it->record;
+        } else {
+          *keep++ = *it;
+        }
+      }
+      m_retired.erase(keep, m_retired.end());
+    }
+
+    const std::string m_config_name;
+    const unsigned m_num_slots;
+    std::unique_ptr<std::atomic<const SharedBlockRecord*>[]> m_slots;
+
+    std::atomic<uint64_t> m_generation;
+    std::array<std::atomic<uint64_t>, NUM_PAGE_GENERATIONS> m_page_generations;
+    std::atomic<uint64_t> m_global_epoch;
+    std::atomic<unsigned> m_num_readers;
+    std::array<ReaderSlot, MAX_READERS> m_readers;
+
+    std::mutex m_retire_mutex;
+    std::vector<Retired> m_retired;
+
+    std::atomic<uint64_t> m_hits{0};
+    std::atomic<uint64_t> m_misses{0};
+    std::atomic<uint64_t> m_publishes{0};
+    std::atomic<uint64_t> m_invalidations{0};
+    std::atomic<uint64_t> m_stale_publishes{0};
+  };
+
+}  // namespace udb
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+
+namespace udb {
+
+  // One translation held by a soft TLB, covering a page of 2^shift bytes.
+  //
+  // For the S-mode and VS-mode TLBs, vpn is a virtual page number and ppn the
+  // (host) physical page number; a VS-mode entry holds the combined VS-stage and
+  // G-stage translation. For the G-stage TLBs, vpn is a guest physical page number.
+  // Both are in 4 KiB units, with the bits below the page size cleared.
+  struct SoftTlbEntry {
+    uint64_t vpn;
+    uint64_t ppn;
+    uint64_t ctx;        // translation context the entry was filled under
+    uint16_t asid;       // 0 for G-stage entries
+    uint16_t vmid;       // 0 for S-mode entries
+    uint16_t pte_flags;  // leaf PTE bits 9:0
+    uint8_t pbmt;
+    uint8_t mode;        // effective privilege mode of the access that filled it
+    uint8_t shift;       // log2 of the page size, 12 - 63
+    bool valid;
+    bool global;
+
+    // mask of the 4 KiB page number bits inside the page
+    uint64_t vpn_mask() const { return (uint64_t{1} << (shift - 12)) - 1; }
+
+    bool matches(uint64_t _vpn, uint64_t _ctx, uint8_t _mode, uint16_t _asid, uint16_t _vmid) const {
+      return valid && (_vpn & ~vpn_mask()) == vpn && ctx == _ctx && mode == _mode && vmid == _vmid &&
+             (global || asid == _asid);
+    }
+  };
+
+  // The set of entries a fence (sfence.vma, hfence.vvma, hfence.gvma, ...) invalidates
+  // in one soft TLB.
+  struct SoftTlbFence {
+    bool single_vmid = false;
+    uint16_t vmid = 0;
+    bool single_asid = false;  // global entries survive an ASID fence
+    uint16_t asid = 0;
+    bool single_page = false;  // only the page (of any size) containing vpn
+    uint64_t vpn = 0;
+
+    bool covers(const SoftTlbEntry& e) const {
+      return e.valid &&
+             (!single_vmid || e.vmid == vmid) &&
+             (!single_asid || (!e.global && e.asid == asid)) &&
+             (!single_page || (vpn & ~e.vpn_mask()) == e.vpn);
+    }
+  };
+
+  // Invalidate the entries of the direct-mapped 4 KiB soft TLB 'tlb' (of 'size' entries,
+  // a power of two) that 'fence' covers. A single-page fence only has to look at
+  // the one slot the page maps to.
+  inline void soft_tlb_fence(SoftTlbEntry* tlb, unsigned size, const SoftTlbFence& fence) {
+    if (fence.single_page) {
+      SoftTlbEntry& e = tlb[fence.vpn & (size - 1)];
+      if (fence.covers(e)) {
+        e.valid = false;
+      }
+      return;
+    }
+    for (unsigned i = 0; i < size; i++) {
+      if (fence.covers(tlb[i])) {
+        tlb[i].valid = false;
+      }
+    }
+  }
+
+  // Entries larger than 4 KiB (superpages and NAPOT pages) of one soft TLB.
+  //
+  // Entries are direct-mapped by page number within their page size, and the sizes in
+  // use are recorded, so a lookup probes one slot per size in use; a 2 MiB or 1 GiB
+  // page takes a single entry.
+  class SoftSuperpageTlb {
+   public:
+    static constexpr unsigned NUM_ENTRIES = 64;
+
+    SoftSuperpageTlb() { invalidate(); }
+
+    const SoftTlbEntry* lookup(uint64_t vpn, uint64_t ctx, uint8_t mode, uint16_t asid, uint16_t vmid) const {
+      for (uint64_t shifts = m_shifts; shifts != 0; shifts &= shifts - 1) {
+        const SoftTlbEntry& e = m_entries[slot(vpn, std::countr_zero(shifts))];
+        if (e.shift == std::countr_zero(shifts) && e.matches(vpn, ctx, mode, asid, vmid)) {
+          return &e;
+        }
+      }
+      return nullptr;
+    }
+
+    void fill(const SoftTlbEntry& entry) {
+      m_entries[slot(entry.vpn, entry.shift)] = entry;
+      m_shifts |= uint64_t{1} << entry.shift;
+    }
+
+    void fence(const SoftTlbFence& fence) {
+      if (fence.single_page) {
+        for (uint64_t shifts = m_shifts; shifts != 0; shifts &= shifts - 1) {
+          SoftTlbEntry& e = m_entries[slot(fence.vpn, std::countr_zero(shifts))];
+          if (fence.covers(e)) {
+            e.valid = false;
+          }
+        }
+        return;
+      }
+      for (SoftTlbEntry& e : m_entries) {
+        if (fence.covers(e)) {
+          e.valid = false;
+        }
+      }
+    }
+
+    void invalidate() {
+      for (SoftTlbEntry& e : m_entries) {
+        e.valid = false;
+      }
+      m_shifts = 0;
+    }
+
+   private:
+    static unsigned slot(uint64_t vpn, unsigned shift) {
+      return ((vpn >> (shift - 12)) ^ shift) & (NUM_ENTRIES - 1);
+    }
+
+    uint64_t m_shifts;  // bit n is set if 2^n-byte entries may be present
+    std::array<SoftTlbEntry, NUM_ENTRIES> m_entries;
+  };
+
+}  // namespace udb
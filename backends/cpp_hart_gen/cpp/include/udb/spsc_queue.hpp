@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+
+namespace udb {
+
+  // Bounded, lock-free, single-producer/single-consumer ring buffer.
+  //
+  // push() may only be called from one thread and pop() from one (other) thread.
+  // Capacity must be a power of two.
+  template <typename T, size_t Capacity>
+    requires ((Capacity != 0) && ((Capacity & (Capacity - 1)) == 0))
+  class SpscQueue {
+   public:
+    SpscQueue() : m_head(0), m_tail(0) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // returns false (and drops item) if the queue is full
+    bool push(const T& item) {
+      const size_t tail = m_tail.load(std::memory_order_relaxed);
+      if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+        return false;
+      }
+      m_items[tail & (Capacity - 1)] = item;
+      m_tail.store(tail + 1, std::memory_order_release);
+      return true;
+    }
+
+    std::optional<T> pop() {
+      const size_t head = m_head.load(std::memory_order_relaxed);
+      if (head == m_tail.load(std::memory_order_acquire)) {
+        return std::nullopt;
+      }
+      T item = m_items[head & (Capacity - 1)];
+      m_head.store(head + 1, std::memory_order_release);
+      return item;
+    }
+
+    bool empty() const {
+      return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+   private:
+    // keep the producer and consumer indices on separate cache lines
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+    alignas(64) std::array<T, Capacity> m_items;
+  };
+
+}  // namespace udb
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "udb/defines.hpp"
+
+namespace udb {
+
+  // broad instruction classes that share a latency
+  enum class InstClass : uint8_t {
+    Alu,
+    Mul,
+    Div,
+    Load,
+    Store,
+    Atomic,
+    Branch,
+    Jump,
+    Csr,
+    Fp,
+    FpDiv,
+    Vector,
+    System
+  };
+
+  // Cycle-approximate timing.
+  //
+  // Every instruction costs the base CPI plus an extra latency for its class.
+  // Costs are summed when a basic block is built and charged once each time the
+  // block runs, so the run loop adds one number per block, not per instruction.
+  // Costs are kept in fixed point so that a fractional CPI accumulates exactly.
+  //
+  // mtime advances one tick for every timebase_ratio cycles.
+  class TimingModel {
+   public:
+    static constexpr unsigned NUM_CLASSES = static_cast<unsigned>(InstClass::System) + 1;
+    static constexpr unsigned FRAC_BITS = 8;
+
+    static constexpr std::array<std::string_view, NUM_CLASSES> CLASS_NAMES = {
+      "alu", "mul", "div", "load", "store", "atomic", "branch",
+      "jump", "csr", "fp", "fpdiv", "vector", "system"
+    };
+
+    TimingModel() : m_timebase_ratio(1) {
+      m_extra = {
+        0,   // alu
+        2,   // mul
+        20,  // div
+        2,   // load
+        0,   // store
+        4,   // atomic
+        1,   // branch
+        1,   // jump
+        2,   // csr
+        3,   // fp
+        15,  // fpdiv
+        4,   // vector
+        4    // system
+      };
+      set_cpi(1.0);
+    }
+
+    static std::optional<InstClass> class_from_name(std::string_view name) {
+      for (unsigned i = 0; i < NUM_CLASSES; i++) {
+        if (CLASS_NAMES[i] == name) {
+          return static_cast<InstClass>(i);
+        }
+      }
+      return std::nullopt;
+    }
+
+    // cycles per instruction, before any class latency
+    void set_cpi(double cpi) {
+      udb_assert(cpi > 0, "CPI must be positive");
+      m_base = static_cast<uint32_t>(std::lround(cpi * (1 << FRAC_BITS)));
+      update_costs();
+    }
+    double cpi() const { return static_cast<double>(m_base) / (1 << FRAC_BITS); }
+
+    // extra cycles charged to instructions of class c
+    void set_latency(InstClass c, uint32_t extra_cycles) {
+      m_extra[static_cast<unsigned>(c)] = extra_cycles;
+      update_costs();
+    }
+    uint32_t latency(InstClass c) const { return m_extra[static_cast<unsigned>(c)]; }
+
+    // cycles per mtime tick
+    void set_timebase_ratio(uint32_t ratio) {
+      udb_assert(ratio != 0, "Timebase ratio must be non-zero");
+      m_timebase_ratio = ratio;
+    }
+    uint32_t timebase_ratio() const { return m_timebase_ratio; }
+
+    // cost of one instruction of class c, in fixed point
+    uint32_t cost(InstClass c) const { return m_cost[static_cast<unsigned>(c)]; }
+
+    static uint64_t to_cycles(uint64_t fixed) { return fixed >> FRAC_BITS; }
+
+   private:
+    void update_costs() {
+      for (unsigned i = 0; i < NUM_CLASSES; i++) {
+        m_cost[i] = m_base + (m_extra[i] << FRAC_BITS);
+      }
+    }
+
+    uint32_t m_base;
+    uint32_t m_timebase_ratio;
+    std::array<uint32_t, NUM_CLASSES> m_extra;
+    std::array<uint32_t, NUM_CLASSES> m_cost;
+  };
+
+}  // namespace udb
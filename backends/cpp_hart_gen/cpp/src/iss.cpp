@@ -2,7 +2,14 @@
 #include <fmt/core.h>
 
 #include <CLI/CLI.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <vector>
 #include <fstream>
 #include <nlohmann/json.hpp>
 
@@ -11,6 +18,8 @@
 #include "udb/hart_factory.hxx"
 #include "udb/inst.hpp"
 #include "udb/iss_soc_model.hpp"
+#include "udb/persistent_bb_cache.hpp"
+#include "udb/timing_model.hpp"
 
 using json = nlohmann::json;
 
@@ -20,8 +29,30 @@ struct Options {
   std::filesystem::path memory_map_path;
   bool show_configs;
   std::string elf_file_path;
+  udb::HartCacheConfig cache_cfg;
+  bool mem_report;
+  unsigned num_harts;
+  bool shared_bb_cache;
+  bool bg_translate;
+  std::filesystem::path bb_cache_dir;
+  uint64_t bb_cache_dir_max_mb;
+  uint64_t clint_base;
+  bool no_spin_skip;
+  std::filesystem::path timing_path;
+  double cpi;
+  uint32_t timebase_ratio;
 
-  Options() : show_configs(false) {}
+  Options()
+      : show_configs(false),
+        mem_report(false),
+        num_harts(1),
+        shared_bb_cache(false),
+        bg_translate(false),
+        bb_cache_dir_max_mb(256),
+        clint_base(0),
+        no_spin_skip(false),
+        cpi(0),
+        timebase_ratio(0) {}
 };
 
 static const int PARSE_OK = 1234;
@@ -33,12 +64,79 @@ int parse_cmdline(int argc, char **argv, Options &options) {
   app.add_flag("-l,--list-configs", options.show_configs,
                "List available configurations");
 
+  app.add_option("--bb-cache-blocks", options.cache_cfg.bb_cache_blocks,
+                 "Number of basic blocks in the decode cache (power of 2)");
+  app.add_option("--tlb-entries", options.cache_cfg.soft_tlb_entries,
+                 "Number of entries in each software TLB (power of 2)");
+  app.add_flag("--mem-report", options.mem_report,
+               "Print hart memory usage on exit");
+  app.add_option("--harts", options.num_harts, "Number of harts to run")
+      ->check(CLI::Range(1u, udb::SharedBlockCache::MAX_READERS));
+  app.add_flag("--shared-bb-cache", options.shared_bb_cache,
+               "Share decoded basic blocks between harts");
+  app.add_flag("--bg-translate", options.bg_translate,
+               "Decode likely blocks on a background thread (implies --shared-bb-cache)");
+  app.add_option("--bb-cache-dir", options.bb_cache_dir,
+                 "Directory to save/restore decoded blocks across runs (implies --shared-bb-cache)");
+  app.add_option("--bb-cache-dir-max-mb", options.bb_cache_dir_max_mb,
+                 "Size limit of --bb-cache-dir, in MiB");
+
+  app.add_option("--clint-base", options.clint_base,
+                 "Add a CLINT at this physical address (e.g., 0x2000000); none by default");
+  app.add_flag("--no-spin-skip", options.no_spin_skip,
+               "Run polling loops instruction by instruction instead of skipping them");
+  app.add_option("--timing", options.timing_path,
+                 "Enable the timing model, with CPI/latencies from a JSON file");
+  app.add_option("--cpi", options.cpi, "Enable the timing model with this base CPI");
+  app.add_option("--timebase-ratio", options.timebase_ratio,
+                 "Enable the timing model with this many cycles per mtime tick");
+
   app.add_option("elf_file", options.elf_file_path, "File to run");
 
   CLI11_PARSE(app, argc, argv);
   return PARSE_OK;
 }
 
+// Timing model file format:
+//
+//   { "cpi": 1.0, "timebase_ratio": 100, "latency": { "div": 20, "load": 3, ... } }
+//
+// All keys are optional; latencies are extra cycles on top of the CPI.
+static std::unique_ptr<udb::TimingModel> make_timing_model(const Options& opts) {
+  if (opts.timing_path.empty() && opts.cpi == 0 && opts.timebase_ratio == 0) {
+    return nullptr;
+  }
+
+  auto timing = std::make_unique<udb::TimingModel>();
+  if (!opts.timing_path.empty()) {
+    std::ifstream f(opts.timing_path);
+    json data = json::parse(f);
+    if (data.contains("cpi")) {
+      timing->set_cpi(data["cpi"].get<double>());
+    }
+    if (data.contains("timebase_ratio")) {
+      timing->set_timebase_ratio(data["timebase_ratio"].get<uint32_t>());
+    }
+    if (data.contains("latency")) {
+      for (const auto& [name, cycles] : data["latency"].items()) {
+        auto c = udb::TimingModel::class_from_name(name);
+        if (!c) {
+          throw std::runtime_error(fmt::format("Unknown instruction class '{}' in {}", name, opts.timing_path.string()));
+        }
+        timing->set_latency(*c, cycles.get<uint32_t>());
+      }
+    }
+  }
+  // command-line values win over the file
+  if (opts.cpi != 0) {
+    timing->set_cpi(opts.cpi);
+  }
+  if (opts.timebase_ratio != 0) {
+    timing->set_timebase_ratio(opts.timebase_ratio);
+  }
+  return timing;
+}
+
 static const std::pair<uint64_t, uint64_t> get_memory_range(std::filesystem::path memmap, std::filesystem::path elf_file_path) {
   json regions;
   uint64_t memsz;
@@ -89,32 +187,215 @@ int main(int argc, char **argv) {
 
   auto range = get_memory_range(opts.memory_map_path, opts.elf_file_path);
   udb::IssSocModel soc(range.second, range.first);
+  if (opts.clint_base != 0) {
+    // CLINT accesses are routed before memory, so it would hide any RAM under it
+    if (opts.clint_base < range.first + range.second &&
+        range.first < opts.clint_base + udb::IssSocModel::CLINT_SIZE) {
+      throw std::runtime_error(fmt::format("CLINT at {:#x} overlaps memory [{:#x}, {:#x})", opts.clint_base,
+                                           range.first, range.first + range.second));
+    }
+    soc.add_clint(opts.clint_base, opts.num_harts);
+  }
 
-  auto hart = udb::HartFactory::create<udb::IssSocModel>(opts.config_name, 0,
-                                                         opts.config_path, soc);
-  auto tracer = udb::HartFactory::create_tracer<udb::IssSocModel>(
-      "riscv-tests", opts.config_name, hart);
-  hart->attach_tracer(tracer);
+  std::shared_ptr<udb::SharedBlockCache> shared_bb_cache;
+  if (opts.shared_bb_cache || opts.bg_translate || !opts.bb_cache_dir.empty()) {
+    shared_bb_cache = std::make_shared<udb::SharedBlockCache>(opts.config_name);
+  }
 
   udb::ElfReader elf_reader(opts.elf_file_path.c_str());
   auto entry_pc = elf_reader.loadLoadableSegments(soc);
-  hart->reset(entry_pc);
 
-  while (true) {
-    auto stop_reason = hart->run_n(100);
-    if (stop_reason != StopReason::InstLimitReached &&
-        stop_reason != StopReason::Exception) {
+  auto read_page = [&soc, &range](uint64_t paddr, std::span<uint8_t, udb::PersistentBlockCache::PAGE_SIZE> buf) {
+    if (paddr < range.first || (paddr - range.first) + buf.size() > range.second) {
+      return false;
+    }
+    for (size_t i = 0; i < buf.size(); i += 8) {
+      uint64_t data = soc.read_physical_memory_64(paddr + i);
+      std::memcpy(&buf[i], &data, 8);
+    }
+    return true;
+  };
+
+  // the background translator decodes with its own hart, which is never run, from
+  // copies of code the running harts submit (it never reads guest memory itself)
+  std::unique_ptr<udb::HartBase<udb::IssSocModel>> decoder_hart;
+  std::unique_ptr<udb::BackgroundTranslator> bg_translator;
+  if (opts.bg_translate) {
+    decoder_hart.reset(udb::HartFactory::create<udb::IssSocModel>(
+        opts.config_name, opts.num_harts, opts.config_path, soc));
+    decoder_hart->reset(entry_pc);
+    bg_translator = std::make_unique<udb::BackgroundTranslator>(
+        shared_bb_cache,
+        [&decoder_hart](const udb::BackgroundTranslator::Candidate& c, udb::SharedBlockRecord& rec) {
+          return decoder_hart->translate_block(c, rec);
+        });
+  }
+
+  auto timing = make_timing_model(opts);
+
+  // all harts watch for stores to cached code
+  auto code_tracker = std::make_shared<udb::CodePageTracker>();
+
+  std::vector<udb::HartBase<udb::IssSocModel>*> harts;
+  for (unsigned i = 0; i < opts.num_harts; i++) {
+    auto hart = udb::HartFactory::create<udb::IssSocModel>(opts.config_name, i,
+                                                           opts.config_path, soc);
+    hart->configure_caches(opts.cache_cfg);
+    hart->attach_code_tracker(code_tracker);
+    hart->enable_spin_detection(!opts.no_spin_skip);
+    hart->attach_timing_model(timing.get());
+    if (shared_bb_cache) {
+      hart->attach_shared_bb_cache(shared_bb_cache);
+    }
+    if (bg_translator) {
+      hart->attach_bg_translator(bg_translator.get());
+    }
+    auto tracer = udb::HartFactory::create_tracer<udb::IssSocModel>(
+        "riscv-tests", opts.config_name, hart);
+    hart->attach_tracer(tracer);
+    hart->reset(entry_pc);
+    harts.push_back(hart);
+  }
+
+  std::unique_ptr<udb::PersistentBlockCache> persistent_bb_cache;
+  if (!opts.bb_cache_dir.empty()) {
+    std::ifstream cfg_file(opts.config_path);
+    std::string cfg_text((std::istreambuf_iterator<char>(cfg_file)), std::istreambuf_iterator<char>());
+    cfg_text += opts.config_name;
+    persistent_bb_cache = std::make_unique<udb::PersistentBlockCache>(
+        opts.bb_cache_dir,
+        udb::PersistentBlockCache::hash_bytes(reinterpret_cast<const uint8_t*>(cfg_text.data()), cfg_text.size()),
+        harts[0]->decode_signature(),
+        opts.bb_cache_dir_max_mb << 20);
+    // no hart fetched the loaded blocks, so their pages aren't held by any; hold them
+    // for the whole run so stores to them still invalidate the blocks
+    persistent_bb_cache->load(*shared_bb_cache, range.first, range.second, read_page,
+                              [&code_tracker](uint64_t paddr) { code_tracker->mark_code(paddr); });
+  }
+
+  if (bg_translator) {
+    bg_translator->start();
+  }
+
+  // harts are run round-robin, 100 instructions at a time. Time advances by one
+  // tick per instruction, or with a timing model, one tick per timebase_ratio
+  // modeled cycles. A hart that executes pause or wrs.sto gives up the rest of
+  // its quantum. A hart that executes wfi, or that is stuck in a polling loop or
+  // waiting in wrs.nto, is parked until it has an interrupt to wake up for (or,
+  // when polling, until what it polls changes). When every hart is parked, time
+  // skips straight to the next timer deadline.
+  enum class HartState { Running, Wfi, Spinning };
+  std::vector<HartState> state(harts.size(), HartState::Running);
+  std::vector<bool> mtip(harts.size(), false);
+  std::vector<bool> msip(harts.size(), false);
+  udb::HartBase<udb::IssSocModel>* exited = nullptr;
+  bool deadlocked = false;
+  uint64_t cycle_carry = 0;  // cycles not yet turned into a whole tick
+  while (exited == nullptr && !deadlocked) {
+    uint64_t round_work = 0;  // instructions (or cycles) run by the busiest hart
+    unsigned num_parked = 0;
+    for (unsigned i = 0; i < harts.size(); i++) {
+      auto hart = harts[i];
+      if (state[i] != HartState::Running) {
+        num_parked++;
+        continue;
+      }
+
+      auto before = timing ? hart->cycles() : hart->num_insts_exec();
+      auto stop_reason = hart->run_n(100);
+      auto after = timing ? hart->cycles() : hart->num_insts_exec();
+      round_work = std::max(round_work, after - before);
+      if (stop_reason == StopReason::InstLimitReached ||
+          stop_reason == StopReason::Exception ||
+          stop_reason == StopReason::Pause) {
+        continue;
+      }
+      if (stop_reason == StopReason::Wfi || stop_reason == StopReason::SpinLoop) {
+        state[i] = (stop_reason == StopReason::Wfi) ? HartState::Wfi : HartState::Spinning;
+        num_parked++;
+        continue;
+      }
+
       if (stop_reason == StopReason::ExitSuccess) {
         fmt::print("SUCCESS - {}\n", hart->exit_reason());
-        break;
       } else if (stop_reason == StopReason::ExitFailure) {
         fmt::print(stderr, "FAIL - {}\n", hart->exit_reason());
-        break;
       } else {
         fmt::print("EXIT - {}\n", hart->exit_reason());
-        break;
       }
+      exited = hart;
+      break;
     }
+    if (exited != nullptr) {
+      break;
+    }
+
+    if (num_parked == harts.size()) {
+      // nothing can happen until the next timer event, so go straight there
+      uint64_t deadline = soc.next_timer_deadline();
+      if (deadline != std::numeric_limits<uint64_t>::max()) {
+        soc.set_time(deadline);
+      } else if (std::ranges::find(state, HartState::Spinning) != state.end()) {
+        // a polling hart may be waiting on time itself (e.g., reading mtime through
+        // the CLINT). Let time move on a quantum and run the pollers normally.
+        soc.advance_time(100);
+        std::ranges::replace(state, HartState::Spinning, HartState::Running);
+      } else {
+        deadlocked = true;
+      }
+    } else if (timing) {
+      cycle_carry += round_work;
+      soc.advance_time(cycle_carry / timing->timebase_ratio());
+      cycle_carry %= timing->timebase_ratio();
+    } else {
+      soc.advance_time(round_work);
+    }
+
+    // drive the CLINT interrupt lines, and wake any hart with an interrupt to take
+    for (unsigned i = 0; i < harts.size(); i++) {
+      if (soc.mtip(i) != mtip[i]) {
+        mtip[i] = !mtip[i];
+        mtip[i] ? harts[i]->set_mmode_timer_int() : harts[i]->clear_mmode_timer_int();
+      }
+      if (soc.msip(i) != msip[i]) {
+        msip[i] = !msip[i];
+        msip[i] ? harts[i]->set_mmode_sw_int() : harts[i]->clear_mmode_sw_int();
+      }
+      if ((state[i] == HartState::Wfi && harts[i]->wakeup_pending()) ||
+          (state[i] == HartState::Spinning && harts[i]->spin_wakeup_pending())) {
+        state[i] = HartState::Running;
+        deadlocked = false;
+      }
+    }
+  }
+
+  if (bg_translator) {
+    bg_translator->stop();
+  }
+
+  if (persistent_bb_cache) {
+    persistent_bb_cache->save(*shared_bb_cache, read_page);
+  }
+
+  if (opts.mem_report) {
+    for (auto hart : harts) {
+      hart->print_memory_usage(stderr);
+    }
+    if (shared_bb_cache) {
+      auto stats = shared_bb_cache->stats();
+      fmt::print(stderr, "Shared block cache: {} bytes, {} hits, {} misses, {} publishes ({} stale), {} invalidations\n",
+                 shared_bb_cache->memory_footprint(), stats.hits, stats.misses,
+                 stats.publishes, stats.stale_publishes, stats.invalidations);
+    }
+    if (bg_translator) {
+      auto stats = bg_translator->stats();
+      fmt::print(stderr, "Background translator: {} submitted, {} dropped, {} translated, {} skipped\n",
+                 stats.submitted, stats.dropped, stats.translated, stats.skipped);
+    }
+  }
+  if (exited == nullptr) {
+    fmt::print(stderr, "FAIL - all harts are waiting for an interrupt that will never arrive\n");
+    return 1;
   }
-  return hart->exit_code();
+  return exited->exit_code();
 }
@@ -21,13 +21,19 @@ EXTERNAL_AS(void, WriteQuadWordToBus, renode_write_quad, uint64_t, uint64_t)
 struct RenodeSocModel {
   uint64_t read_hpm_counter(uint64_t counternum) { return 0; }
 
+  // harts use the timing model for mcycle; this is only used without one
   uint64_t read_mcycle() { return 0; }
-  uint64_t read_mtime() { return 0; }
+  uint64_t read_mtime();
 
   // returns new value of mcycle (could be different than new_value)
   uint64_t sw_write_mcycle(uint64_t new_value) { return 0; }
 
-  void cache_block_zero(uint64_t paddr) {}
+  // Renode only exposes the bus, so the block is zeroed a doubleword at a time
+  void cache_block_zero(uint64_t paddr, uint64_t size) {
+    for (uint64_t offset = 0; offset < size; offset += 8) {
+      renode_write_quad(paddr + offset, 0);
+    }
+  }
 
   // eei_* occur when the configuration indicates that ecall/ebreak don't cause
   // exceptions
@@ -107,6 +113,11 @@ struct RenodeSocModel {
 
 static RenodeSocModel callbacks;
 static udb::HartBase<RenodeSocModel>* hart = nullptr;
+static udb::TimingModel timing;
+
+uint64_t RenodeSocModel::read_mtime() {
+  return (hart == nullptr) ? 0 : hart->cycles() / timing.timebase_ratio();
+}
 
 extern "C" UDB_EXPORT int32_t renode_init_ex(uint32_t hart_id,
                                              const char* model_name,
@@ -117,6 +128,7 @@ extern "C" UDB_EXPORT int32_t renode_init_ex(uint32_t hart_id,
 
   hart = udb::HartFactory::create<RenodeSocModel>(
       model_name, hart_id, std::filesystem::path{cfg_path}, callbacks);
+  hart->attach_timing_model(&timing);
 
   return 0;
 }
@@ -0,0 +1,277 @@
+
+#include "udb/persistent_bb_cache.hpp"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <system_error>
+#include <vector>
+
+namespace udb {
+
+  namespace {
+    constexpr std::array<char, 8> MAGIC = {'U', 'D', 'B', 'B', 'B', 'C', '\0', '\0'};
+    constexpr const char* FILE_EXT = ".udbbb";
+
+    struct FileHeader {
+      std::array<char, 8> magic;
+      uint32_t version;
+      uint32_t num_blocks;
+      uint64_t config_hash;
+      uint64_t decode_signature;
+      uint64_t content_hash;
+    };
+
+    struct BlockHeader {
+      uint32_t page_offset;
+      uint32_t num_insts;
+      uint64_t ctx;
+    };
+
+    struct InstEntry {
+      uint64_t encoding;
+      uint32_t kind;
+      uint32_t reserved;
+    };
+
+    // length, in bytes, of a RISC-V instruction from its low bits
+    unsigned inst_len(uint64_t encoding) { return ((encoding & 0x3) == 0x3) ? 4 : 2; }
+
+    // does the encoding match the page contents at offset?
+    bool matches_page(std::span<const uint8_t, PersistentBlockCache::PAGE_SIZE> page,
+                      uint64_t offset, uint64_t encoding) {
+      unsigned len = inst_len(encoding);
+      if (offset + len > PersistentBlockCache::PAGE_SIZE) {
+        return false;
+      }
+      uint64_t in_page = 0;
+      std::memcpy(&in_page, page.data() + offset, len);
+      uint64_t mask = (len == 4) ? 0xffffffffull : 0xffffull;
+      return in_page == (encoding & mask);
+    }
+  }  // namespace
+
+  PersistentBlockCache::PersistentBlockCache(const std::filesystem::path& dir,
+                                             uint64_t config_hash,
+                                             uint64_t decode_signature,
+                                             uint64_t max_bytes)
+      : m_dir(dir),
+        m_config_hash(config_hash),
+        m_decode_signature(decode_signature),
+        m_max_bytes(max_bytes) {
+    std::filesystem::create_directories(m_dir);
+  }
+
+  uint64_t PersistentBlockCache::hash_bytes(const uint8_t* data, size_t len, uint64_t seed) {
+    uint64_t h = seed ^ (len * 0x9e3779b97f4a7c15ull);
+    while (len >= 8) {
+      uint64_t w;
+      std::memcpy(&w, data, 8);
+      w *= 0x87c37b91114253d5ull;
+      w = (w << 31) | (w >> 33);
+      w *= 0x4cf5ad432745937full;
+      h ^= w;
+      h = ((h << 27) | (h >> 37)) * 5 + 0x52dce729;
+      data += 8;
+      len -= 8;
+    }
+    while (len > 0) {
+      h = (h ^ *data++) * 0x100000001b3ull;
+      len--;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  std::filesystem::path PersistentBlockCache::page_file(uint64_t content_hash) const {
+    return m_dir / fmt::format("{:016x}-{:016x}-v{}-{:016x}{}", m_config_hash, m_decode_signature,
+                               FORMAT_VERSION, content_hash, FILE_EXT);
+  }
+
+  size_t PersistentBlockCache::load(SharedBlockCache& cache, uint64_t base, uint64_t size,
+                                    const ReadPageFn& read_page, const LoadedPageFn& on_page) {
+    std::array<uint8_t, PAGE_SIZE> page;
+    size_t num_loaded = 0;
+
+    const uint64_t first = base & ~(PAGE_SIZE - 1);
+    for (uint64_t page_addr = first; page_addr < base + size; page_addr += PAGE_SIZE) {
+      // read before the page, so records checked against a page that is then written
+      // are dropped
+      const uint64_t gen = cache.generation(page_addr);
+      if (!read_page(page_addr, page)) {
+        continue;
+      }
+      const uint64_t content_hash = hash_bytes(page.data(), PAGE_SIZE);
+      const auto path = page_file(content_hash);
+
+      std::ifstream in(path, std::ios::binary);
+      if (!in) {
+        continue;
+      }
+
+      FileHeader hdr;
+      if (!in.read(reinterpret_cast<char*>(&hdr), sizeof(hdr)) || hdr.magic != MAGIC ||
+          hdr.version != FORMAT_VERSION || hdr.config_hash != m_config_hash ||
+          hdr.decode_signature != m_decode_signature || hdr.content_hash != content_hash) {
+        continue;
+      }
+
+      SharedBlockRecord rec;
+      bool published = false;
+      for (uint32_t b = 0; b < hdr.num_blocks; b++) {
+        BlockHeader bh;
+        if (!in.read(reinterpret_cast<char*>(&bh), sizeof(bh)) ||
+            bh.num_insts == 0 || bh.num_insts > SharedBlockRecord::MAX_INSTS) {
+          break;
+        }
+
+        rec.pc = page_addr + bh.page_offset;
+        rec.paddr = rec.pc;
+        rec.ctx = bh.ctx;
+        rec.num_insts = bh.num_insts;
+
+        // the content hash should guarantee this, but checking each encoding against the
+        // page is cheap and rules out collisions
+        bool valid = true;
+        uint64_t offset = bh.page_offset;
+        for (uint32_t i = 0; i < bh.num_insts; i++) {
+          InstEntry e;
+          if (!in.read(reinterpret_cast<char*>(&e), sizeof(e))) {
+            valid = false;
+            break;
+          }
+          valid = valid && matches_page(page, offset, e.encoding);
+          rec.insts[i] = {e.encoding, e.kind};
+          offset += inst_len(e.encoding);
+        }
+        if (!in) {
+          break;
+        }
+        if (valid && cache.publish(rec, gen)) {
+          num_loaded++;
+          published = true;
+        }
+      }
+      if (published && on_page) {
+        on_page(page_addr);
+      }
+
+      // mark as recently used for LRU trimming
+      std::error_code ec;
+      std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    }
+
+    return num_loaded;
+  }
+
+  size_t PersistentBlockCache::save(SharedBlockCache& cache, const ReadPageFn& read_page) {
+    // collect blocks with a physical address that fit in one page, by page
+    std::map<uint64_t, std::vector<SharedBlockRecord>> pages;
+    {
+      unsigned reader = cache.register_reader();
+      SharedBlockCache::ReadGuard guard(cache, reader);
+      cache.for_each([&pages](const SharedBlockRecord& rec) {
+        if (rec.paddr == SharedBlockRecord::UNKNOWN_PADDR || rec.num_insts == 0) {
+          return;
+        }
+        uint64_t len = 0;
+        for (unsigned i = 0; i < rec.num_insts; i++) {
+          len += inst_len(rec.insts[i].encoding);
+        }
+        const uint64_t page_addr = rec.paddr & ~(PAGE_SIZE - 1);
+        if ((rec.paddr + len) > (page_addr + PAGE_SIZE)) {
+          return;
+        }
+        pages[page_addr].push_back(rec);
+      });
+    }
+
+    std::array<uint8_t, PAGE_SIZE> page;
+    size_t num_saved = 0;
+    for (const auto& [page_addr, blocks] : pages) {
+      if (!read_page(page_addr, page)) {
+        continue;
+      }
+      const uint64_t content_hash = hash_bytes(page.data(), PAGE_SIZE);
+      const auto path = page_file(content_hash);
+
+      // write to a temporary and rename, so concurrent runs never see a partial file
+      auto tmp = path;
+      tmp += fmt::format(".tmp{}", static_cast<const void*>(&page));
+      {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+          continue;
+        }
+        FileHeader hdr{MAGIC, FORMAT_VERSION, static_cast<uint32_t>(blocks.size()),
+                       m_config_hash, m_decode_signature, content_hash};
+        out.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+        for (const auto& rec : blocks) {
+          BlockHeader bh{static_cast<uint32_t>(rec.paddr - page_addr), rec.num_insts, rec.ctx};
+          out.write(reinterpret_cast<const char*>(&bh), sizeof(bh));
+          for (unsigned i = 0; i < rec.num_insts; i++) {
+            InstEntry e{rec.insts[i].encoding, rec.insts[i].kind, 0};
+            out.write(reinterpret_cast<const char*>(&e), sizeof(e));
+          }
+        }
+        if (!out) {
+          std::error_code ec;
+          std::filesystem::remove(tmp, ec);
+          continue;
+        }
+      }
+      std::error_code ec;
+      std::filesystem::rename(tmp, path, ec);
+      if (ec) {
+        std::filesystem::remove(tmp, ec);
+        continue;
+      }
+      num_saved += blocks.size();
+    }
+
+    enforce_limit();
+    return num_saved;
+  }
+
+  void PersistentBlockCache::enforce_limit() {
+    struct Entry {
+      std::filesystem::path path;
+      std::filesystem::file_time_type mtime;
+      uintmax_t size;
+    };
+    std::vector<Entry> entries;
+    uintmax_t total = 0;
+
+    std::error_code ec;
+    for (const auto& f : std::filesystem::directory_iterator(m_dir, ec)) {
+      if (!f.is_regular_file(ec) || f.path().extension() != FILE_EXT) {
+        continue;
+      }
+      Entry e{f.path(), f.last_write_time(ec), f.file_size(ec)};
+      total += e.size;
+      entries.push_back(std::move(e));
+    }
+    if (total <= m_max_bytes) {
+      return;
+    }
+
+    // least recently used first
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry& a, const Entry& b) { return a.mtime < b.mtime; });
+    for (const auto& e : entries) {
+      if (total <= m_max_bytes) {
+        break;
+      }
+      if (std::filesystem::remove(e.path, ec)) {
+        total -= e.size;
+      }
+    }
+  }
+
+}  // namespace udb
@@ -0,0 +1,41 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <udb/bb_cache.hpp>
+
+using namespace udb;
+
+TEST_CASE("blocks take arena space for the instructions they hold", "[bb_cache]") {
+  BasicBlockCache<64> cache;
+  cache.resize(64);
+
+  auto first = cache.get(0x1000);
+  cache.begin_block(first, 0x1000, 0x1000, 0);
+  for (unsigned i = 0; i < 10; i++) {
+    first->alloc_inst();
+  }
+  auto second = cache.get(0x1004);
+  cache.begin_block(second, 0x1004, 0x1004, 0);
+  REQUIRE(second->storage() == first->storage() + 10);
+
+  // starting the same block again reuses its space
+  second->alloc_inst();
+  cache.begin_block(second, 0x1004, 0x1004, 0);
+  REQUIRE(second->storage() == first->storage() + 10);
+
+  // once every segment has been used, allocation wraps around and drops the oldest blocks
+  uint64_t pc = 0x2008;
+  unsigned num_blocks = 0;
+  while (first->valid()) {
+    auto bb = cache.get(pc);
+    cache.begin_block(bb, pc, pc, 0);
+    for (unsigned i = 0; i < 10; i++) {
+      bb->alloc_inst();
+    }
+    pc += 4;
+    num_blocks++;
+    REQUIRE(num_blocks <= BasicBlockCache<64>::NUM_SEGMENTS * cache.segment_insts() / 10);
+  }
+  REQUIRE(cache.get(pc - 4)->segment() == 0);
+  REQUIRE(cache.get(pc - 8)->valid());
+  REQUIRE(!second->valid());
+}
@@ -0,0 +1,110 @@
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <thread>
+
+#include <udb/bg_translator.hpp>
+#include <udb/spsc_queue.hpp>
+
+using namespace udb;
+
+TEST_CASE("spsc queue order and capacity", "[bg_translator]") {
+  SpscQueue<int, 4> q;
+  REQUIRE(q.empty());
+  for (int i = 0; i < 4; i++) {
+    REQUIRE(q.push(i));
+  }
+  REQUIRE(!q.push(4));  // full
+
+  for (int i = 0; i < 4; i++) {
+    auto v = q.pop();
+    REQUIRE(v.has_value());
+    REQUIRE(*v == i);
+  }
+  REQUIRE(!q.pop().has_value());
+}
+
+TEST_CASE("spsc queue across threads", "[bg_translator]") {
+  SpscQueue<uint64_t, 64> q;
+  constexpr uint64_t N = 100000;
+
+  std::thread producer([&q]() {
+    for (uint64_t i = 0; i < N; i++) {
+      while (!q.push(i)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint64_t expected = 0;
+  while (expected < N) {
+    if (auto v = q.pop()) {
+      REQUIRE(*v == expected);
+      expected++;
+    }
+  }
+  producer.join();
+}
+
+TEST_CASE("background translation publishes blocks", "[bg_translator]") {
+  auto cache = std::make_shared<SharedBlockCache>("test", 64);
+  unsigned reader = cache->register_reader();
+
+  BackgroundTranslator bg(cache, [](const BackgroundTranslator::Candidate& c, SharedBlockRecord& rec) {
+    if (c.ctx != 0) {
+      return false;  // pretend we can only translate context 0
+    }
+    // one 32-bit instruction, decoded from the copy of the code
+    rec.pc = c.pc;
+    rec.paddr = c.paddr;
+    rec.ctx = c.ctx;
+    rec.num_insts = 1;
+    rec.insts[0] = {uint64_t{c.code[0]} | (uint64_t{c.code[1]} << 8) | (uint64_t{c.code[2]} << 16) |
+                    (uint64_t{c.code[3]} << 24), 0};
+    return true;
+  });
+  unsigned producer = bg.register_producer();
+  bg.start();
+
+  auto candidate = [&cache](uint64_t pc, uint64_t ctx) {
+    BackgroundTranslator::Candidate c{};
+    c.pc = pc;
+    c.ctx = ctx;
+    c.paddr = 0x80000000 + pc;
+    c.generation = cache->generation(c.paddr);
+    c.num_bytes = 4;
+    c.code = {0x13, 0x05, 0x10, 0x00};  // addi a0, zero, 1
+    return c;
+  };
+  bg.submit(producer, candidate(0x1000, 0));
+  bg.submit(producer, candidate(0x2000, 1));
+
+  // the code is written after it was copied
+  auto stale = candidate(0x3000, 0);
+  cache->invalidate_page(stale.paddr);
+  bg.submit(producer, stale);
+
+  // wait for the worker to drain the queue
+  for (int i = 0; i < 1000; i++) {
+    auto stats = bg.stats();
+    if (stats.translated + stats.skipped == 3) {
+      break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  bg.stop();
+
+  auto stats = bg.stats();
+  REQUIRE(stats.submitted == 3);
+  REQUIRE(stats.translated == 1);
+  REQUIRE(stats.skipped == 2);
+
+  SharedBlockCache::ReadGuard guard(*cache, reader);
+  const SharedBlockRecord* rec = cache->lookup(0x1000, 0);
+  REQUIRE(rec != nullptr);
+  REQUIRE(rec->paddr == 0x80001000);
+  REQUIRE(rec->insts[0].encoding == 0x00100513);
+  REQUIRE(cache->lookup(0x2000, 1) == nullptr);
+  REQUIRE(cache->lookup(0x3000, 0) == nullptr);
+}
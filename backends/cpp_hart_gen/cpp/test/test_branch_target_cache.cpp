@@ -0,0 +1,65 @@
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <udb/branch_target_cache.hpp>
+
+using namespace udb;
+
+static BranchTarget make_target(uint64_t pc, uint64_t epoch = 1) {
+  return BranchTarget{pc, pc + 0x40000000, epoch, 1, true};
+}
+
+TEST_CASE("link register hints", "[branch_target_cache]") {
+  // jal ra, jal x0, jalr x0, 0(ra) (ret), jalr ra, 0(t0), jalr t0, 0(t0)
+  REQUIRE(ras_action(JumpKind::Jal, 0x000000ef) == RasAction::Push);
+  REQUIRE(ras_action(JumpKind::Jal, 0x0000006f) == RasAction::None);
+  REQUIRE(ras_action(JumpKind::Jalr, 0x00008067) == RasAction::Pop);
+  REQUIRE(ras_action(JumpKind::Jalr, 0x000280e7) == RasAction::PopThenPush);
+  REQUIRE(ras_action(JumpKind::Jalr, 0x000282e7) == RasAction::Push);
+  REQUIRE(ras_action(JumpKind::Jalr, 0x00030067) == RasAction::None);  // jr t1
+
+  // c.jr ra, c.jalr a0, c.j
+  REQUIRE(ras_action(JumpKind::CJr, 0x8082) == RasAction::Pop);
+  REQUIRE(ras_action(JumpKind::CJalr, 0x9502) == RasAction::Push);
+  REQUIRE(ras_action(JumpKind::CJ, 0xa001) == RasAction::None);
+
+  REQUIRE(jump_is_indirect(JumpKind::Jalr));
+  REQUIRE(!jump_is_indirect(JumpKind::Jal));
+}
+
+TEST_CASE("indirect targets are tagged by source block and target", "[branch_target_cache]") {
+  IndirectTargetCache cache;
+  int a, b;
+  REQUIRE(cache.lookup(&a, 0x1000, 1, 1) == nullptr);
+
+  cache.fill(&a, make_target(0x1000));
+  REQUIRE(cache.lookup(&a, 0x1000, 1, 1)->paddr == 0x40001000);
+  REQUIRE(cache.lookup(&b, 0x1000, 1, 1) == nullptr);
+  REQUIRE(cache.lookup(&a, 0x2000, 1, 1) == nullptr);
+  REQUIRE(cache.lookup(&a, 0x1000, 2, 1) == nullptr);  // the mapping may have changed
+  REQUIRE(cache.lookup(&a, 0x1000, 1, 3) == nullptr);  // other privilege mode
+
+  cache.invalidate();
+  REQUIRE(cache.lookup(&a, 0x1000, 1, 1) == nullptr);
+}
+
+TEST_CASE("return address stack", "[branch_target_cache]") {
+  ReturnAddressStack ras;
+  REQUIRE(!ras.pop().valid);
+
+  ras.push(make_target(0x100));
+  ras.push(make_target(0x200));
+  REQUIRE(ras.pop().pc == 0x200);
+  REQUIRE(ras.pop().pc == 0x100);
+  REQUIRE(ras.size() == 0);
+
+  // deep recursion keeps the most recent entries
+  for (uint64_t i = 0; i < ReturnAddressStack::DEPTH + 4; i++) {
+    ras.push(make_target(0x1000 + i * 4));
+  }
+  REQUIRE(ras.size() == ReturnAddressStack::DEPTH);
+  for (uint64_t i = ReturnAddressStack::DEPTH + 4; i > 4; i--) {
+    REQUIRE(ras.pop().pc == 0x1000 + (i - 1) * 4);
+  }
+  REQUIRE(!ras.pop().valid);
+}
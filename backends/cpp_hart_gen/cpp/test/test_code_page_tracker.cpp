@@ -0,0 +1,162 @@
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <thread>
+#include <vector>
+
+#include <udb/bb_cache.hpp>
+#include <udb/code_page_tracker.hpp>
+
+using namespace udb;
+
+TEST_CASE("code page filter", "[code_page_tracker]") {
+  CodePageTracker tracker;
+  REQUIRE(!tracker.maybe_code(0x80001000));
+
+  tracker.mark_code(0x80001234);
+  REQUIRE(tracker.maybe_code(0x80001000));
+  REQUIRE(tracker.maybe_code(0x80001ffc));
+  REQUIRE(!tracker.maybe_code(0x80002000));
+
+  // the page stops hitting once nothing holds it
+  tracker.mark_code(0x80001000);
+  tracker.release_code(0x80001);
+  REQUIRE(tracker.maybe_code(0x80001000));
+  tracker.release_code(0x80001);
+  REQUIRE(!tracker.maybe_code(0x80001000));
+}
+
+TEST_CASE("drain written pages", "[code_page_tracker]") {
+  CodePageTracker tracker;
+  uint64_t seen = tracker.sequence();
+
+  tracker.note_write(0x80001000);
+  tracker.note_write(0x80003008);
+
+  std::vector<uint64_t> pages;
+  REQUIRE(tracker.drain(seen, [&pages](uint64_t ppn) { pages.push_back(ppn); }));
+  REQUIRE((pages == std::vector<uint64_t>{0x80001, 0x80003}));
+  REQUIRE(seen == tracker.sequence());
+
+  // nothing new
+  pages.clear();
+  REQUIRE(tracker.drain(seen, [&pages](uint64_t ppn) { pages.push_back(ppn); }));
+  REQUIRE(pages.empty());
+}
+
+TEST_CASE("drain reports lost writes", "[code_page_tracker]") {
+  CodePageTracker tracker;
+  uint64_t seen = tracker.sequence();
+
+  for (unsigned i = 0; i < CodePageTracker::RING_SIZE + 1; i++) {
+    tracker.note_write(i << CodePageTracker::PAGE_SHIFT);
+  }
+  REQUIRE(!tracker.drain(seen, [](uint64_t) {}));
+  REQUIRE(seen == tracker.sequence());
+}
+
+TEST_CASE("writes from several threads are drained or reported lost", "[code_page_tracker]") {
+  CodePageTracker tracker;
+  uint64_t seen = tracker.sequence();
+
+  std::vector<std::thread> writers;
+  for (unsigned t = 0; t < 4; t++) {
+    writers.emplace_back([&tracker, t]() {
+      for (unsigned i = 0; i < 1000; i++) {
+        tracker.note_write(uint64_t{t + 1} << CodePageTracker::PAGE_SHIFT);
+      }
+    });
+  }
+  uint64_t num_drained = 0;
+  bool lost = false;
+  while (tracker.sequence() < 4000 || seen < 4000) {
+    lost = !tracker.drain(seen, [&num_drained](uint64_t ppn) {
+      REQUIRE((ppn >= 1 && ppn <= 4));
+      num_drained++;
+    }) || lost;
+  }
+  for (auto& w : writers) {
+    w.join();
+  }
+  REQUIRE((lost || num_drained == 4000));
+}
+
+TEST_CASE("invalidate blocks on a page", "[code_page_tracker]") {
+  BasicBlockCache<64> cache;
+  cache.resize(16);
+
+  auto a = cache.get(0x1000);
+  cache.begin_block(a, 0x1000, 0x1000, 0);
+  a->code_pages().add(0x1);
+
+  auto b = cache.get(0x2004);
+  cache.begin_block(b, 0x2004, 0x2004, 0);
+  b->code_pages().add(0x2);
+  b->code_pages().add(0x3);
+
+  cache.invalidate_page(0x3);
+  REQUIRE(a->valid());
+  REQUIRE(!b->valid());
+
+  // a block with untracked pages is on every page
+  auto c = cache.get(0x3008);
+  cache.begin_block(c, 0x3008, 0x3008, 0);
+  c->code_pages().overflow = true;
+  cache.invalidate_page(0x1234);
+  REQUIRE(!c->valid());
+  REQUIRE(a->valid());
+}
+
+TEST_CASE("blocks are tagged by physical address", "[code_page_tracker]") {
+  BasicBlockCache<64> cache;
+  cache.resize(16);
+
+  // built at virtual address 0x40001000, which maps to 0x80002000
+  auto a = cache.get(0x80002000);
+  REQUIRE(!a->matches(0x80002000, 0));
+  cache.begin_block(a, 0x40001000, 0x80002000, 0);
+
+  // another address space maps the same code somewhere else
+  REQUIRE(cache.get(0x80002000) == a);
+  REQUIRE(a->matches(0x80002000, 0));
+  REQUIRE(!a->matches(0x80002000, 1));  // decoded under another context
+  REQUIRE(!a->matches(0x80012000, 0));  // same slot, other code
+
+  a->invalidate();
+  REQUIRE(!a->matches(0x80002000, 0));
+}
+
+TEST_CASE("blocks hold their code pages until dropped", "[code_page_tracker]") {
+  CodePageTracker tracker;
+  BasicBlockCache<64> cache;
+  cache.resize(16);
+
+  // what a hart does while fetching the block's instructions
+  auto record = [&tracker](CodePages& pages, uint64_t paddr) {
+    pages.tracker = &tracker;
+    if (pages.add(CodePageTracker::ppn(paddr))) {
+      tracker.mark_code(paddr);
+    }
+  };
+
+  auto a = cache.get(0x1000);
+  cache.begin_block(a, 0x1000, 0x1000, 0);
+  record(a->code_pages(), 0x1000);
+  record(a->code_pages(), 0x1004);
+  auto b = cache.get(0x1ff8);
+  cache.begin_block(b, 0x1ff8, 0x1ff8, 0);
+  record(b->code_pages(), 0x1ff8);
+  record(b->code_pages(), 0x2000);
+  REQUIRE(tracker.maybe_code(0x1800));
+  REQUIRE(tracker.maybe_code(0x2800));
+
+  // a store to the second page drops b, after which nothing holds that page
+  cache.invalidate_page(0x2);
+  REQUIRE(!b->valid());
+  REQUIRE(tracker.maybe_code(0x1800));
+  REQUIRE(!tracker.maybe_code(0x2800));
+
+  // reusing a slot lets go of the old block's pages
+  cache.begin_block(a, 0x1000, 0x1000, 0);
+  REQUIRE(!tracker.maybe_code(0x1800));
+}
@@ -0,0 +1,330 @@
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <array>
+
+#include <udb/crypto.hpp>
+
+using namespace udb;
+
+namespace {
+  uint64_t load64(const std::array<uint8_t, 16>& bytes, unsigned offset) {
+    uint64_t v = 0;
+    for (unsigned i = 0; i < 8; i++) {
+      v |= static_cast<uint64_t>(bytes[offset + i]) << (8 * i);
+    }
+    return v;
+  }
+
+  crypto::ElementGroup load128(const std::array<uint8_t, 16>& bytes) {
+    return (static_cast<crypto::ElementGroup>(load64(bytes, 8)) << 64) | load64(bytes, 0);
+  }
+
+  uint32_t load32_be(const std::array<uint8_t, 16>& bytes, unsigned offset) {
+    return (bytes[offset] << 24) | (bytes[offset + 1] << 16) | (bytes[offset + 2] << 8) | bytes[offset + 3];
+  }
+}  // namespace
+
+TEST_CASE("aes-128 with the rv64 instructions", "[crypto]") {
+  // FIPS-197, appendix C.1
+  const std::array<uint8_t, 16> key = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                                       0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+  const std::array<uint8_t, 16> pt = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                                      0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+  const std::array<uint8_t, 16> ct = {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+                                      0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a};
+
+  std::array<uint64_t, 22> rk;
+  rk[0] = load64(key, 0);
+  rk[1] = load64(key, 8);
+  for (unsigned r = 0; r < 10; r++) {
+    rk[2 * r + 2] = crypto::aes64_key_schedule2(crypto::aes64_key_schedule1(rk[2 * r + 1], r), rk[2 * r]);
+    rk[2 * r + 3] = crypto::aes64_key_schedule2(rk[2 * r + 2], rk[2 * r + 1]);
+  }
+
+  uint64_t s0 = load64(pt, 0) ^ rk[0];
+  uint64_t s1 = load64(pt, 8) ^ rk[1];
+  for (unsigned r = 1; r < 10; r++) {
+    const uint64_t n0 = crypto::aes64_encrypt(s0, s1, true);
+    const uint64_t n1 = crypto::aes64_encrypt(s1, s0, true);
+    s0 = n0 ^ rk[2 * r];
+    s1 = n1 ^ rk[2 * r + 1];
+  }
+  uint64_t n0 = crypto::aes64_encrypt(s0, s1, false);
+  uint64_t n1 = crypto::aes64_encrypt(s1, s0, false);
+  s0 = n0 ^ rk[20];
+  s1 = n1 ^ rk[21];
+  REQUIRE(s0 == load64(ct, 0));
+  REQUIRE(s1 == load64(ct, 8));
+
+  // and back, with the equivalent inverse cipher
+  s0 ^= rk[20];
+  s1 ^= rk[21];
+  for (unsigned r = 9; r > 0; r--) {
+    n0 = crypto::aes64_decrypt(s0, s1, true);
+    n1 = crypto::aes64_decrypt(s1, s0, true);
+    s0 = n0 ^ crypto::aes64_inv_mix_columns(rk[2 * r]);
+    s1 = n1 ^ crypto::aes64_inv_mix_columns(rk[2 * r + 1]);
+  }
+  n0 = crypto::aes64_decrypt(s0, s1, false);
+  n1 = crypto::aes64_decrypt(s1, s0, false);
+  REQUIRE((n0 ^ rk[0]) == load64(pt, 0));
+  REQUIRE((n1 ^ rk[1]) == load64(pt, 8));
+}
+
+TEST_CASE("host and portable aes agree", "[crypto]") {
+  const uint64_t a = 0x0123456789abcdefull;
+  const uint64_t b = 0xfedcba9876543210ull;
+  const uint64_t fwd = crypto::detail::aes64_sub_shift<false>(a, b);
+  const uint64_t inv = crypto::detail::aes64_sub_shift<true>(a, b);
+
+  REQUIRE(crypto::aes64_encrypt(a, b, false) == fwd);
+  REQUIRE(crypto::aes64_encrypt(a, b, true) ==
+          (crypto::detail::mix_column(static_cast<uint32_t>(fwd)) |
+           (static_cast<uint64_t>(crypto::detail::mix_column(static_cast<uint32_t>(fwd >> 32))) << 32)));
+  REQUIRE(crypto::aes64_decrypt(a, b, false) == inv);
+  REQUIRE(crypto::aes64_inv_mix_columns(a) ==
+          (crypto::detail::inv_mix_column(static_cast<uint32_t>(a)) |
+           (static_cast<uint64_t>(crypto::detail::inv_mix_column(static_cast<uint32_t>(a >> 32))) << 32)));
+}
+
+TEST_CASE("aes32 instructions build a column", "[crypto]") {
+  const uint32_t w = 0x3a7f05c1;
+
+  uint32_t enc = 0;
+  uint32_t dec = 0;
+  uint32_t inv_sub = 0;
+  for (unsigned bs = 0; bs < 4; bs++) {
+    enc = crypto::aes32_encrypt(enc, w, bs, true);
+    dec = crypto::aes32_decrypt(dec, w, bs, true);
+    inv_sub |= static_cast<uint32_t>(crypto::detail::AES_INV_SBOX[(w >> (8 * bs)) & 0xff]) << (8 * bs);
+  }
+  REQUIRE(enc == crypto::detail::mix_column(crypto::detail::sub_word(w)));
+  REQUIRE(dec == crypto::detail::inv_mix_column(inv_sub));
+
+  REQUIRE(crypto::aes32_encrypt(0, w, 2, false) == (static_cast<uint32_t>(crypto::detail::AES_SBOX[0x7f]) << 16));
+}
+
+TEST_CASE("sm4 with the zksed instructions", "[crypto]") {
+  // GB/T 32907-2016, example 1
+  const std::array<uint8_t, 16> key = {0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef,
+                                       0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10};
+  const std::array<uint8_t, 16> ct = {0x68, 0x1e, 0xdf, 0x34, 0xd2, 0x06, 0x96, 0x5e,
+                                      0x86, 0xb3, 0xe9, 0x4f, 0x53, 0x6e, 0x42, 0x46};
+  const std::array<uint32_t, 4> fk = {0xa3b1bac6, 0x56aa3350, 0x677d9197, 0xb27022dc};
+
+  std::array<uint32_t, 36> k;
+  for (unsigned i = 0; i < 4; i++) {
+    k[i] = load32_be(key, 4 * i) ^ fk[i];
+  }
+  for (unsigned i = 0; i < 32; i++) {
+    uint32_t ck = 0;
+    for (unsigned j = 0; j < 4; j++) {
+      ck = (ck << 8) | (((4 * i + j) * 7) & 0xff);
+    }
+    const uint32_t t = k[i + 1] ^ k[i + 2] ^ k[i + 3] ^ ck;
+    uint32_t x = k[i];
+    for (unsigned bs = 0; bs < 4; bs++) {
+      x = crypto::sm4_round(x, t, bs, true);
+    }
+    k[i + 4] = x;
+  }
+
+  std::array<uint32_t, 36> x;
+  for (unsigned i = 0; i < 4; i++) {
+    x[i] = load32_be(key, 4 * i);  // the plaintext is the same as the key
+  }
+  for (unsigned i = 0; i < 32; i++) {
+    const uint32_t t = x[i + 1] ^ x[i + 2] ^ x[i + 3] ^ k[i + 4];
+    uint32_t y = x[i];
+    for (unsigned bs = 0; bs < 4; bs++) {
+      y = crypto::sm4_round(y, t, bs, false);
+    }
+    x[i + 4] = y;
+  }
+  for (unsigned i = 0; i < 4; i++) {
+    REQUIRE(x[35 - i] == load32_be(ct, 4 * i));
+  }
+}
+
+TEST_CASE("carry-less multiply", "[crypto]") {
+  uint64_t lo, hi;
+  crypto::clmul(3, 3, lo, hi);
+  REQUIRE(lo == 5);
+  REQUIRE(hi == 0);
+
+  const uint64_t a = 0x8000000000000001ull;
+  const uint64_t b = 0xc000000000000003ull;
+  crypto::clmul(a, b, lo, hi);
+
+  uint64_t ref_lo = 0, ref_hi = 0;
+  for (unsigned i = 0; i < 64; i++) {
+    if ((b >> i) & 1) {
+      ref_lo ^= a << i;
+      ref_hi ^= (i == 0) ? 0 : (a >> (64 - i));
+    }
+  }
+  REQUIRE(lo == ref_lo);
+  REQUIRE(hi == ref_hi);
+}
+
+TEST_CASE("crossbar permutation", "[crypto]") {
+  // nibble i of the result is nibble (indices[i]) of the table
+  REQUIRE(crypto::xperm(0x76543210, 0x01234567, 4, 32) == 0x01234567);
+  REQUIRE(crypto::xperm(0xfedcba9876543210ull, 0x000000000000001full, 4, 64) == 0x000000000000001full);
+  // out of range indices give zero
+  REQUIRE(crypto::xperm(0x76543210, 0x000000f8, 4, 32) == 0x00000000);
+  REQUIRE(crypto::xperm(0x44332211, 0x04030201, 8, 32) == 0x00443322);
+}
+
+TEST_CASE("hash sigma functions", "[crypto]") {
+  REQUIRE(crypto::sha256_sig0(1) == ((1u << 25) ^ (1u << 14)));
+  REQUIRE(crypto::sha512_sum0(1) == ((1ull << 36) ^ (1ull << 30) ^ (1ull << 25)));
+  REQUIRE(crypto::sm3_p0(1) == (1u ^ (1u << 9) ^ (1u << 17)));
+}
+
+TEST_CASE("aes with the zvkned instructions", "[crypto]") {
+  const std::array<uint8_t, 16> pt = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                                      0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+
+  SECTION("aes-128") {
+    // FIPS-197, appendix C.1
+    const std::array<uint8_t, 16> key = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                                         0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+    const std::array<uint8_t, 16> ct = {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+                                        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a};
+
+    std::array<crypto::ElementGroup, 11> rk;
+    rk[0] = load128(key);
+    for (unsigned r = 1; r <= 10; r++) {
+      rk[r] = crypto::vaes_key_expand128(rk[r - 1], r);
+    }
+
+    crypto::ElementGroup s = load128(pt) ^ rk[0];  // vaesz.vs
+    for (unsigned r = 1; r < 10; r++) {
+      s = crypto::vaes_encrypt_round(s, rk[r], true);
+    }
+    s = crypto::vaes_encrypt_round(s, rk[10], false);
+    REQUIRE(s == load128(ct));
+
+    // the vector instructions use the standard inverse cipher
+    s ^= rk[10];
+    for (unsigned r = 9; r > 0; r--) {
+      s = crypto::vaes_decrypt_round(s, rk[r], true);
+    }
+    s = crypto::vaes_decrypt_round(s, rk[0], false);
+    REQUIRE(s == load128(pt));
+  }
+
+  SECTION("aes-256") {
+    // FIPS-197, appendix C.3
+    const std::array<uint8_t, 16> key_lo = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                                            0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+    const std::array<uint8_t, 16> key_hi = {0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+                                            0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f};
+    const std::array<uint8_t, 16> ct = {0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf,
+                                        0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89};
+
+    std::array<crypto::ElementGroup, 15> rk;
+    rk[0] = load128(key_lo);
+    rk[1] = load128(key_hi);
+    for (unsigned r = 2; r <= 14; r++) {
+      rk[r] = crypto::vaes_key_expand256(rk[r - 2], rk[r - 1], r);
+    }
+
+    crypto::ElementGroup s = load128(pt) ^ rk[0];
+    for (unsigned r = 1; r < 14; r++) {
+      s = crypto::vaes_encrypt_round(s, rk[r], true);
+    }
+    s = crypto::vaes_encrypt_round(s, rk[14], false);
+    REQUIRE(s == load128(ct));
+  }
+}
+
+TEST_CASE("ghash with the zvkg instructions", "[crypto]") {
+  // GCM specification, test case 2: H = E(0^128, 0^128), one block of ciphertext
+  const std::array<uint8_t, 16> h = {0x66, 0xe9, 0x4b, 0xd4, 0xef, 0x8a, 0x2c, 0x3b,
+                                     0x88, 0x4c, 0xfa, 0x59, 0xca, 0x34, 0x2b, 0x2e};
+  const std::array<uint8_t, 16> c = {0x03, 0x88, 0xda, 0xce, 0x60, 0xb6, 0xa3, 0x92,
+                                     0xf3, 0x28, 0xc2, 0xb9, 0x71, 0xb2, 0xfe, 0x78};
+  const std::array<uint8_t, 16> lengths = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x80};
+  const std::array<uint8_t, 16> ghash = {0xf3, 0x8c, 0xbb, 0x1a, 0xd6, 0x92, 0x23, 0xdc,
+                                         0xc3, 0x45, 0x7a, 0xe5, 0xb6, 0xb0, 0xf8, 0x85};
+
+  crypto::ElementGroup y = 0;
+  y = crypto::vghash_mul(y ^ load128(c), load128(h));        // vghsh.vv
+  y = crypto::vghash_mul(y ^ load128(lengths), load128(h));  // vghsh.vv
+  REQUIRE(y == load128(ghash));
+
+  // 1 is the multiplicative identity; in GCM bit order that is the top bit of the first byte
+  REQUIRE(crypto::vghash_mul(load128(h), 0x80) == load128(h));  // vgmul.vv
+}
+
+TEST_CASE("sha-256 with the zvknha instructions", "[crypto]") {
+  constexpr std::array<uint32_t, 64> K = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+  constexpr std::array<uint32_t, 8> H0 = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                          0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+  auto eg = [](uint32_t w0, uint32_t w1, uint32_t w2, uint32_t w3) {
+    return static_cast<crypto::ElementGroup>(w0) | (static_cast<crypto::ElementGroup>(w1) << 32) |
+           (static_cast<crypto::ElementGroup>(w2) << 64) | (static_cast<crypto::ElementGroup>(w3) << 96);
+  };
+  auto word = [](crypto::ElementGroup g, unsigned i) { return static_cast<uint32_t>(g >> (32 * i)); };
+
+  // the padded message "abc", four words per element group
+  std::array<crypto::ElementGroup, 4> w = {eg(0x61626380, 0, 0, 0), 0, 0, eg(0, 0, 0, 0x18)};
+
+  // {a, b, e, f} and {c, d, g, h}
+  crypto::ElementGroup abef = eg(H0[5], H0[4], H0[1], H0[0]);
+  crypto::ElementGroup cdgh = eg(H0[7], H0[6], H0[3], H0[2]);
+  for (unsigned round = 0; round < 64; round += 4) {
+    const crypto::ElementGroup m = w[(round / 4) % 4];
+    const crypto::ElementGroup wk =
+      eg(word(m, 0) + K[round], word(m, 1) + K[round + 1], word(m, 2) + K[round + 2], word(m, 3) + K[round + 3]);
+
+    // after two rounds, {c, d, g, h} is the old {a, b, e, f}
+    cdgh = crypto::vsha256_compress(cdgh, abef, wk, false);  // vsha2cl.vv
+    abef = crypto::vsha256_compress(abef, cdgh, wk, true);   // vsha2ch.vv
+
+    if (round < 48) {
+      // vmerge builds {W[11], W[10], W[9], W[4]}; vsha2ms.vv
+      const unsigned i = (round / 4) % 4;
+      const crypto::ElementGroup mid =
+        (w[(i + 2) % 4] & ~static_cast<crypto::ElementGroup>(0xffffffff)) | word(w[(i + 1) % 4], 0);
+      w[i] = crypto::vsha256_message_schedule(w[i], mid, w[(i + 3) % 4]);
+    }
+  }
+
+  const std::array<uint32_t, 8> digest = {
+    H0[0] + word(abef, 3), H0[1] + word(abef, 2), H0[2] + word(cdgh, 3), H0[3] + word(cdgh, 2),
+    H0[4] + word(abef, 1), H0[5] + word(abef, 0), H0[6] + word(cdgh, 1), H0[7] + word(cdgh, 0)};
+  const std::array<uint32_t, 8> expected = {0xba7816bf, 0x8f01cfea, 0x414140de, 0x5dae2223,
+                                            0xb00361a3, 0x96177a9c, 0xb410ff61, 0xf20015ad};
+  REQUIRE(digest == expected);
+}
+
+TEST_CASE("host and portable vector rounds agree", "[crypto]") {
+  const crypto::ElementGroup a = (static_cast<crypto::ElementGroup>(0x0123456789abcdefull) << 64) | 0xfedcba9876543210ull;
+  const crypto::ElementGroup b = (static_cast<crypto::ElementGroup>(0x0f1e2d3c4b5a6978ull) << 64) | 0x8796a5b4c3d2e1f0ull;
+
+  // the portable round, from the rv64 instructions
+  const uint64_t lo = static_cast<uint64_t>(a), hi = a >> 64;
+  const crypto::ElementGroup dec = ((static_cast<crypto::ElementGroup>(crypto::detail::aes64_sub_shift<true>(hi, lo)) << 64) |
+                                    crypto::detail::aes64_sub_shift<true>(lo, hi)) ^ b;
+  const crypto::ElementGroup dec_mix = (static_cast<crypto::ElementGroup>(crypto::aes64_inv_mix_columns(dec >> 64)) << 64) |
+                                       crypto::aes64_inv_mix_columns(static_cast<uint64_t>(dec));
+  REQUIRE(crypto::vaes_decrypt_round(a, b, false) == dec);
+  REQUIRE(crypto::vaes_decrypt_round(a, b, true) == dec_mix);
+
+  // two rounds of compression with both message word pairs
+  const crypto::ElementGroup c = a ^ b;
+  REQUIRE(crypto::vsha256_compress(a, b, c, true) == crypto::vsha256_compress(a, b, c >> 64, false));
+}
@@ -0,0 +1,76 @@
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <udb/hpm_counters.hpp>
+
+using namespace udb;
+
+TEST_CASE("idle until programmed", "[hpm_counters]") {
+  HpmCounters hpm;
+  REQUIRE(!hpm.active());
+
+  hpm.program(3, static_cast<uint64_t>(HpmEvent::Loads));
+  REQUIRE(hpm.active());
+  REQUIRE(hpm.programmed(3));
+
+  hpm.program(3, 0);
+  REQUIRE(!hpm.active());
+}
+
+TEST_CASE("counters follow their event", "[hpm_counters]") {
+  HpmCounters hpm;
+  hpm.program(3, static_cast<uint64_t>(HpmEvent::InstRetired));
+  hpm.program(4, static_cast<uint64_t>(HpmEvent::Loads));
+  hpm.program(5, static_cast<uint64_t>(HpmEvent::Stores));
+  hpm.program(6, static_cast<uint64_t>(HpmEvent::TakenBranches));
+
+  HpmCounters::ClassCounts counts{};
+  counts[static_cast<unsigned>(InstClass::Alu)] = 5;
+  counts[static_cast<unsigned>(InstClass::Load)] = 2;
+  counts[static_cast<unsigned>(InstClass::Atomic)] = 1;
+  hpm.count_block(counts);
+  hpm.count_block(counts);
+  hpm.count_inst(InstClass::Branch);
+  hpm.count_taken_branch();
+
+  REQUIRE(hpm.read(3) == 17);
+  REQUIRE(hpm.read(4) == 6);
+  REQUIRE(hpm.read(5) == 2);
+  REQUIRE(hpm.read(6) == 1);
+}
+
+TEST_CASE("writes and reprogramming keep the value", "[hpm_counters]") {
+  HpmCounters hpm;
+  hpm.program(3, static_cast<uint64_t>(HpmEvent::Traps));
+  hpm.count_trap();
+  hpm.write(3, 100);
+  hpm.count_trap();
+  REQUIRE(hpm.read(3) == 101);
+
+  hpm.program(3, static_cast<uint64_t>(HpmEvent::PageWalks));
+  REQUIRE(hpm.read(3) == 101);
+  hpm.count_page_walk();
+  REQUIRE(hpm.read(3) == 102);
+
+  // unknown events count nothing
+  hpm.program(3, 0x1234);
+  REQUIRE(!hpm.programmed(3));
+  hpm.count_page_walk();
+  REQUIRE(hpm.read(3) == 102);
+}
+
+TEST_CASE("inhibited counters stop", "[hpm_counters]") {
+  HpmCounters hpm;
+  hpm.program(7, static_cast<uint64_t>(HpmEvent::FpOps));
+  hpm.count_inst(InstClass::Fp);
+
+  hpm.set_inhibit(1u << 7);
+  hpm.count_inst(InstClass::FpDiv);
+  REQUIRE(hpm.read(7) == 1);
+  hpm.write(7, 10);
+  REQUIRE(hpm.read(7) == 10);
+
+  hpm.set_inhibit(0);
+  hpm.count_inst(InstClass::Fp);
+  REQUIRE(hpm.read(7) == 11);
+}
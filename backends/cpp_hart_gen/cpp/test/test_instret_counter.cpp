@@ -0,0 +1,102 @@
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <udb/instret_counter.hpp>
+
+using namespace udb;
+
+// Drives an InstretCounter the way the hart does: each instruction executes against the
+// retire count so far, then retires.
+struct Hart {
+  InstretCounter instret;
+  uint64_t retired = 0;
+
+  void retire(unsigned n = 1) { retired += n; }
+
+  uint64_t csrr_minstret() {
+    uint64_t value = instret.read(retired);
+    retire();
+    return value;
+  }
+
+  // RV64: csrw minstret, value
+  void csrw_minstret(uint64_t value) {
+    instret.sw_write(value, retired);
+    retire();
+  }
+
+  // RV32: csrw minstret, value (low half)
+  void csrw_minstret_lo(uint32_t value) {
+    instret.sw_write((instret.read(retired) & 0xffffffff00000000ull) | value, retired);
+    retire();
+  }
+
+  // RV32: csrw minstreth, value
+  void csrw_minstreth(uint32_t value) {
+    instret.sw_write((uint64_t{value} << 32) | (instret.read(retired) & 0xffffffffull), retired);
+    retire();
+  }
+
+  uint32_t csrr_minstreth() {
+    uint32_t value = instret.read(retired) >> 32;
+    retire();
+    return value;
+  }
+};
+
+TEST_CASE("minstret counts retired instructions", "[instret_counter]") {
+  Hart hart;
+  hart.retire(10);
+  REQUIRE(hart.csrr_minstret() == 10);
+  REQUIRE(hart.csrr_minstret() == 11);
+}
+
+TEST_CASE("the instruction after csrw minstret reads the written value", "[instret_counter]") {
+  Hart hart;
+  hart.retire(5);
+  hart.csrw_minstret(1000);
+  REQUIRE(hart.csrr_minstret() == 1000);
+  hart.retire(3);
+  REQUIRE(hart.csrr_minstret() == 1004);
+
+  hart.csrw_minstret(0);
+  REQUIRE(hart.csrr_minstret() == 0);
+}
+
+TEST_CASE("RV32 minstret/minstreth writes read back exactly", "[instret_counter]") {
+  Hart hart;
+  hart.retire(7);
+
+  hart.csrw_minstret_lo(0xfffffff0);
+  REQUIRE(hart.csrr_minstret() == 0xfffffff0);
+
+  hart.csrw_minstreth(0x12345678);
+  REQUIRE(hart.csrr_minstreth() == 0x12345678);
+
+  // the usual sequence: clear the low half, write the high half, then the low half
+  hart.csrw_minstret_lo(0);
+  hart.csrw_minstreth(0xabcd);
+  hart.csrw_minstret_lo(0x100);
+  REQUIRE(hart.csrr_minstret() == 0x0000abcd00000100ull);
+  REQUIRE(hart.csrr_minstreth() == 0xabcd);
+}
+
+TEST_CASE("inhibited minstret holds its value", "[instret_counter]") {
+  Hart hart;
+  hart.retire(4);
+  hart.instret.set_counting(false, hart.retired);
+  hart.retire(10);
+  REQUIRE(hart.instret.read(hart.retired) == 4);
+
+  // nothing increments a stopped counter, including the writing instruction
+  hart.csrw_minstret(50);
+  REQUIRE(hart.csrr_minstret() == 50);
+  REQUIRE(hart.csrr_minstret() == 50);
+
+  hart.instret.set_counting(true, hart.retired);
+  REQUIRE(hart.csrr_minstret() == 50);
+  REQUIRE(hart.csrr_minstret() == 51);
+
+  hart.instret.reset();
+  REQUIRE(hart.instret.read(0) == 0);
+}
@@ -0,0 +1,52 @@
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <udb/jump_table_cache.hpp>
+
+using namespace udb;
+
+TEST_CASE("entries hit only in their context", "[jump_table_cache]") {
+  JumpTableCache cache;
+  uint64_t target = 0;
+  REQUIRE(cache.empty());
+  REQUIRE(!cache.lookup(1, 32, target));
+
+  cache.fill(1, 32, 0x80001100, 8, 0x80000400);
+  REQUIRE(!cache.empty());
+  REQUIRE(cache.lookup(1, 32, target));
+  REQUIRE(target == 0x80000400);
+  REQUIRE(!cache.lookup(1, 33, target));
+  REQUIRE(!cache.lookup(2, 32, target));
+
+  // filling under a new context drops the old one
+  cache.fill(2, 33, 0x80001108, 8, 0x80000500);
+  REQUIRE(!cache.lookup(2, 32, target));
+  REQUIRE(cache.lookup(2, 33, target));
+  REQUIRE(target == 0x80000500);
+}
+
+TEST_CASE("stores to a cached entry invalidate", "[jump_table_cache]") {
+  JumpTableCache cache;
+  uint64_t target = 0;
+  cache.fill(1, 32, 0x80001100, 4, 0x80000400);
+  cache.fill(1, 40, 0x80001120, 4, 0x80000800);
+
+  // outside of the entries read
+  cache.note_store(0x800010f8, 8);
+  cache.note_store(0x80001124, 4);
+  REQUIRE(cache.lookup(1, 32, target));
+
+  // overlapping the last byte of an entry
+  cache.note_store(0x80001123, 1);
+  REQUIRE(cache.empty());
+  REQUIRE(!cache.lookup(1, 40, target));
+}
+
+TEST_CASE("invalidate drops everything", "[jump_table_cache]") {
+  JumpTableCache cache;
+  uint64_t target = 0;
+  cache.fill(0, 255, 0x1000, 8, 0x2000);
+  cache.invalidate();
+  REQUIRE(cache.empty());
+  REQUIRE(!cache.lookup(0, 255, target));
+}
@@ -0,0 +1,141 @@
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#include <udb/persistent_bb_cache.hpp>
+
+using namespace udb;
+
+namespace {
+  // a tiny guest memory starting at BASE
+  constexpr uint64_t BASE = 0x80000000;
+
+  struct FakeMemory {
+    std::vector<uint8_t> data = std::vector<uint8_t>(4 * PersistentBlockCache::PAGE_SIZE);
+
+    void write32(uint64_t addr, uint32_t value) { std::memcpy(&data[addr - BASE], &value, 4); }
+
+    PersistentBlockCache::ReadPageFn reader() {
+      return [this](uint64_t paddr, std::span<uint8_t, PersistentBlockCache::PAGE_SIZE> buf) {
+        if (paddr < BASE || (paddr - BASE) + buf.size() > data.size()) {
+          return false;
+        }
+        std::memcpy(buf.data(), &data[paddr - BASE], buf.size());
+        return true;
+      };
+    }
+  };
+
+  SharedBlockRecord make_record(FakeMemory& mem, uint64_t pc, unsigned n) {
+    SharedBlockRecord rec{};
+    rec.pc = pc;
+    rec.paddr = pc;
+    rec.ctx = 7;
+    rec.num_insts = n;
+    for (unsigned i = 0; i < n; i++) {
+      uint32_t enc = 0x00000013 | ((i + 1) << 20);  // addi x0, x0, i+1
+      mem.write32(pc + 4 * i, enc);
+      rec.insts[i] = {enc, i};
+    }
+    return rec;
+  }
+
+  // publish a record whose code was read just now
+  bool publish_current(SharedBlockCache& cache, const SharedBlockRecord& rec) {
+    return cache.publish(rec, cache.generation(rec.paddr));
+  }
+
+  std::filesystem::path fresh_dir(const char* name) {
+    auto dir = std::filesystem::temp_directory_path() / name;
+    std::filesystem::remove_all(dir);
+    return dir;
+  }
+}  // namespace
+
+TEST_CASE("save and reload", "[persistent_bb_cache]") {
+  auto dir = fresh_dir("udb_test_pbc_reload");
+  FakeMemory mem;
+
+  {
+    SharedBlockCache cache("test", 64);
+    publish_current(cache, make_record(mem, BASE + 0x100, 3));
+    publish_current(cache, make_record(mem, BASE + 0x1200, 2));
+
+    // unknown physical address: never saved
+    SharedBlockRecord virt = make_record(mem, BASE + 0x2000, 1);
+    virt.paddr = SharedBlockRecord::UNKNOWN_PADDR;
+    publish_current(cache, virt);
+
+    PersistentBlockCache pbc(dir, 1, 2, 1 << 20);
+    REQUIRE(pbc.save(cache, mem.reader()) == 2);
+  }
+
+  SharedBlockCache cache("test", 64);
+  unsigned reader = cache.register_reader();
+  PersistentBlockCache pbc(dir, 1, 2, 1 << 20);
+  std::vector<uint64_t> pages;
+  REQUIRE(pbc.load(cache, BASE, mem.data.size(), mem.reader(),
+                   [&pages](uint64_t paddr) { pages.push_back(paddr); }) == 2);
+  REQUIRE((pages == std::vector<uint64_t>{BASE, BASE + PersistentBlockCache::PAGE_SIZE}));
+
+  SharedBlockCache::ReadGuard guard(cache, reader);
+  const SharedBlockRecord* rec = cache.lookup(BASE + 0x100, 7);
+  REQUIRE(rec != nullptr);
+  REQUIRE(rec->num_insts == 3);
+  REQUIRE(rec->insts[2].kind == 2);
+  REQUIRE(cache.lookup(BASE + 0x2000, 7) == nullptr);
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("changed pages and other configs are not loaded", "[persistent_bb_cache]") {
+  auto dir = fresh_dir("udb_test_pbc_changed");
+  FakeMemory mem;
+
+  {
+    SharedBlockCache cache("test", 64);
+    publish_current(cache, make_record(mem, BASE + 0x100, 3));
+    PersistentBlockCache pbc(dir, 1, 2, 1 << 20);
+    REQUIRE(pbc.save(cache, mem.reader()) == 1);
+  }
+
+  {
+    // different decoder
+    SharedBlockCache cache("test", 64);
+    PersistentBlockCache pbc(dir, 1, 3, 1 << 20);
+    REQUIRE(pbc.load(cache, BASE, mem.data.size(), mem.reader()) == 0);
+  }
+
+  {
+    // page content changed
+    mem.write32(BASE + 0x800, 0xdeadbeef);
+    SharedBlockCache cache("test", 64);
+    PersistentBlockCache pbc(dir, 1, 2, 1 << 20);
+    REQUIRE(pbc.load(cache, BASE, mem.data.size(), mem.reader()) == 0);
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("size limit", "[persistent_bb_cache]") {
+  auto dir = fresh_dir("udb_test_pbc_limit");
+  FakeMemory mem;
+
+  SharedBlockCache cache("test", 64);
+  for (unsigned p = 0; p < 4; p++) {
+    publish_current(cache, make_record(mem, BASE + p * PersistentBlockCache::PAGE_SIZE, 4));
+  }
+  PersistentBlockCache pbc(dir, 1, 2, 200);
+  pbc.save(cache, mem.reader());
+
+  uintmax_t total = 0;
+  for (const auto& f : std::filesystem::directory_iterator(dir)) {
+    total += f.file_size();
+  }
+  REQUIRE(total <= 200);
+
+  std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,165 @@
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstring>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <udb/pool_alloc.hpp>
+
+using namespace udb;
+
+struct PoolObj64 {
+  uint64_t words[8];
+};
+
+using Pool = PoolAllocator<PoolObj64, sizeof(PoolObj64), 16>;
+
+TEST_CASE("objects don't overlap", "[pool_alloc]") {
+  Pool pool;
+  std::vector<PoolObj64*> objs;
+  for (unsigned i = 0; i < 100; i++) {
+    PoolObj64* obj = pool.allocate();
+    REQUIRE(reinterpret_cast<uintptr_t>(obj) % alignof(std::max_align_t) == 0);
+    std::memset(obj, i, sizeof(PoolObj64));
+    objs.push_back(obj);
+  }
+  for (unsigned i = 0; i < 100; i++) {
+    REQUIRE(objs[i]->words[0] == 0x0101010101010101ull * i);
+    REQUIRE(objs[i]->words[7] == 0x0101010101010101ull * i);
+  }
+  for (PoolObj64* obj : objs) {
+    pool.free(obj);
+  }
+}
+
+TEST_CASE("freed objects are reused by their own pool", "[pool_alloc]") {
+  Pool a;
+  Pool b;
+  PoolObj64* obj = a.allocate();
+  a.free(obj);
+  REQUIRE(b.allocate() != obj);
+  REQUIRE(a.allocate() == obj);
+
+  // release finds the pool from the address
+  Pool::release(obj);
+  REQUIRE(a.allocate() == obj);
+}
+
+TEST_CASE("reset returns every object", "[pool_alloc]") {
+  Pool pool;
+  for (unsigned i = 0; i < 100; i++) {
+    pool.allocate();
+  }
+  const size_t footprint = pool.memory_footprint();
+  REQUIRE(footprint > 0);
+
+  pool.reset();
+  for (unsigned i = 0; i < 100; i++) {
+    pool.allocate();
+  }
+  REQUIRE(pool.memory_footprint() == footprint);
+}
+
+TEST_CASE("stale and double frees are dropped", "[pool_alloc]") {
+  Pool pool;
+  pool.allocate();
+  PoolObj64* stale = pool.allocate();
+  pool.reset();
+
+  // 'stale' is from before the reset, and its slot hasn't been handed out again
+  pool.free(stale);
+  std::set<PoolObj64*> unique;
+  for (unsigned i = 0; i < 40; i++) {
+    REQUIRE(unique.insert(pool.allocate()).second);
+  }
+
+  PoolObj64* obj = pool.allocate();
+  pool.free(obj);
+  pool.free(obj);
+  REQUIRE(pool.allocate() == obj);
+  REQUIRE(pool.allocate() != obj);
+}
+
+TEST_CASE("pools used in turn by one thread keep their objects apart", "[pool_alloc]") {
+  constexpr unsigned NUM_POOLS = 6;
+  std::vector<std::unique_ptr<Pool>> pools;
+  for (unsigned p = 0; p < NUM_POOLS; p++) {
+    pools.emplace_back(std::make_unique<Pool>());
+  }
+
+  // round-robin, the way several harts share a thread
+  std::vector<std::vector<PoolObj64*>> live(NUM_POOLS);
+  for (unsigned round = 0; round < 50; round++) {
+    for (unsigned p = 0; p < NUM_POOLS; p++) {
+      PoolObj64* obj = pools[p]->allocate();
+      obj->words[0] = p;
+      live[p].push_back(obj);
+      if (round % 3 == 2) {
+        Pool::release(live[p].front());
+        live[p].erase(live[p].begin());
+      }
+    }
+  }
+  std::set<PoolObj64*> unique;
+  for (unsigned p = 0; p < NUM_POOLS; p++) {
+    for (PoolObj64* obj : live[p]) {
+      REQUIRE(obj->words[0] == p);
+      REQUIRE(unique.insert(obj).second);
+    }
+  }
+}
+
+TEST_CASE("concurrent allocation and cross-thread frees", "[pool_alloc]") {
+  Pool pool;
+  constexpr unsigned NUM_THREADS = 4;
+  constexpr unsigned NUM_OBJS = 2000;
+
+  // each thread allocates, tags, and hands its objects to the next thread to free
+  std::vector<std::vector<PoolObj64*>> allocated(NUM_THREADS);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < NUM_THREADS; t++) {
+    threads.emplace_back([&pool, &allocated, t]() {
+      for (unsigned i = 0; i < NUM_OBJS; i++) {
+        PoolObj64* obj = pool.allocate();
+        obj->words[0] = t;
+        obj->words[1] = i;
+        allocated[t].push_back(obj);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  threads.clear();
+
+  std::set<PoolObj64*> unique;
+  for (unsigned t = 0; t < NUM_THREADS; t++) {
+    for (unsigned i = 0; i < NUM_OBJS; i++) {
+      REQUIRE(allocated[t][i]->words[0] == t);
+      REQUIRE(allocated[t][i]->words[1] == i);
+      unique.insert(allocated[t][i]);
+    }
+  }
+  REQUIRE(unique.size() == NUM_THREADS * NUM_OBJS);
+
+  for (unsigned t = 0; t < NUM_THREADS; t++) {
+    threads.emplace_back([&allocated, t]() {
+      for (PoolObj64* obj : allocated[(t + 1) % NUM_THREADS]) {
+        Pool::release(obj);
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  // everything freed went back to the depot when the threads exited, so no new chunks
+  const size_t footprint = pool.memory_footprint();
+  for (unsigned i = 0; i < NUM_THREADS * NUM_OBJS; i++) {
+    pool.allocate();
+  }
+  REQUIRE(pool.memory_footprint() == footprint);
+}
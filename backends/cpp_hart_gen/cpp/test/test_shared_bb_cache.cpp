@@ -0,0 +1,160 @@
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <thread>
+#include <vector>
+
+#include <udb/shared_bb_cache.hpp>
+
+using namespace udb;
+
+static SharedBlockRecord make_record(uint64_t pc, uint64_t ctx, unsigned n) {
+  SharedBlockRecord rec{};
+  rec.pc = pc;
+  rec.ctx = ctx;
+  rec.num_insts = n;
+  for (unsigned i = 0; i < n; i++) {
+    rec.insts[i] = {pc + 4 * i, i};
+  }
+  return rec;
+}
+
+// publish a record whose code was read just now
+static bool publish_current(SharedBlockCache& cache, const SharedBlockRecord& rec) {
+  return cache.publish(rec, cache.generation(rec.paddr));
+}
+
+TEST_CASE("lookup", "[shared_bb_cache]") {
+  SharedBlockCache cache("test", 64);
+  unsigned reader = cache.register_reader();
+
+  publish_current(cache, make_record(0x1000, 1, 3));
+
+  SharedBlockCache::ReadGuard guard(cache, reader);
+  const SharedBlockRecord* rec = cache.lookup(0x1000, 1);
+  REQUIRE(rec != nullptr);
+  REQUIRE(rec->num_insts == 3);
+  REQUIRE(rec->insts[2].encoding == 0x1008);
+
+  // same pc, different context
+  REQUIRE(cache.lookup(0x1000, 2) == nullptr);
+  REQUIRE(cache.lookup(0x2000, 1) == nullptr);
+}
+
+TEST_CASE("invalidate", "[shared_bb_cache]") {
+  SharedBlockCache cache("test", 64);
+  unsigned reader = cache.register_reader();
+
+  publish_current(cache, make_record(0x1000, 1, 1));
+  cache.invalidate();
+  {
+    SharedBlockCache::ReadGuard guard(cache, reader);
+    REQUIRE(cache.lookup(0x1000, 1) == nullptr);
+  }
+
+  // republishing after an invalidate makes the block visible again
+  publish_current(cache, make_record(0x1000, 1, 1));
+  {
+    SharedBlockCache::ReadGuard guard(cache, reader);
+    REQUIRE(cache.lookup(0x1000, 1) != nullptr);
+  }
+}
+
+TEST_CASE("invalidate one page", "[shared_bb_cache]") {
+  SharedBlockCache cache("test", 64);
+  unsigned reader = cache.register_reader();
+
+  auto on_page = [](uint64_t pc, uint64_t paddr) {
+    SharedBlockRecord rec = make_record(pc, 1, 1);
+    rec.paddr = paddr;
+    return rec;
+  };
+  publish_current(cache, on_page(0x1000, 0x80001000));
+  publish_current(cache, on_page(0x2000, 0x80002000));
+  SharedBlockRecord unknown = make_record(0x3000, 1, 1);
+  unknown.paddr = SharedBlockRecord::UNKNOWN_PADDR;
+  publish_current(cache, unknown);
+
+  cache.invalidate_page(0x80001ffc);
+  {
+    SharedBlockCache::ReadGuard guard(cache, reader);
+    REQUIRE(cache.lookup(0x1000, 1) == nullptr);
+    REQUIRE(cache.lookup(0x2000, 1) != nullptr);
+    REQUIRE(cache.lookup(0x3000, 1) != nullptr);
+  }
+
+  // a block republished on the page after the invalidate is visible
+  publish_current(cache, on_page(0x1000, 0x80001000));
+  {
+    SharedBlockCache::ReadGuard guard(cache, reader);
+    REQUIRE(cache.lookup(0x1000, 1) != nullptr);
+  }
+}
+
+TEST_CASE("a block whose code changed while it was read is dropped", "[shared_bb_cache]") {
+  SharedBlockCache cache("test", 64);
+  unsigned reader = cache.register_reader();
+
+  SharedBlockRecord rec = make_record(0x1000, 1, 1);
+  rec.paddr = 0x80001000;
+
+  // the page is written between reading its code and publishing
+  uint64_t gen = cache.generation(rec.paddr);
+  cache.invalidate_page(rec.paddr);
+  REQUIRE_FALSE(cache.publish(rec, gen));
+
+  gen = cache.generation(rec.paddr);
+  cache.invalidate();
+  REQUIRE_FALSE(cache.publish(rec, gen));
+  {
+    SharedBlockCache::ReadGuard guard(cache, reader);
+    REQUIRE(cache.lookup(0x1000, 1) == nullptr);
+  }
+
+  // a write to another page doesn't matter
+  gen = cache.generation(rec.paddr);
+  cache.invalidate_page(0x80002000);
+  REQUIRE(cache.publish(rec, gen));
+  {
+    SharedBlockCache::ReadGuard guard(cache, reader);
+    REQUIRE(cache.lookup(0x1000, 1) != nullptr);
+  }
+
+  auto stats = cache.stats();
+  REQUIRE(stats.publishes == 1);
+  REQUIRE(stats.stale_publishes == 2);
+}
+
+TEST_CASE("concurrent readers and writers", "[shared_bb_cache]") {
+  SharedBlockCache cache("test", 16);
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < 4; t++) {
+    threads.emplace_back([&cache, t]() {
+      unsigned reader = cache.register_reader();
+      for (unsigned i = 0; i < 10000; i++) {
+        uint64_t pc = 0x1000 + 4 * (i % 64);
+        const uint64_t gen = cache.generation(0);
+        {
+          SharedBlockCache::ReadGuard guard(cache, reader);
+          const SharedBlockRecord* rec = cache.lookup(pc, 0);
+          if (rec != nullptr) {
+            // records are immutable; every field must still be consistent
+            REQUIRE(rec->pc == pc);
+            REQUIRE(rec->insts[0].encoding == pc);
+          }
+        }
+        cache.publish(make_record(pc, 0, 1 + (i % 8)), gen);
+        if (t == 0 && (i % 1000) == 0) {
+          cache.invalidate();
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  auto stats = cache.stats();
+  REQUIRE(stats.publishes + stats.stale_publishes == 40000);
+}
@@ -0,0 +1,111 @@
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <udb/soft_tlb.hpp>
+
+using namespace udb;
+
+static SoftTlbEntry make_entry(uint64_t vpn, uint16_t asid, uint16_t vmid, bool global) {
+  SoftTlbEntry e{};
+  e.vpn = vpn;
+  e.ppn = vpn + 0x100;
+  e.ctx = 7;
+  e.asid = asid;
+  e.vmid = vmid;
+  e.mode = 1;
+  e.shift = 12;
+  e.valid = true;
+  e.global = global;
+  return e;
+}
+
+TEST_CASE("entries match their tags", "[soft_tlb]") {
+  SoftTlbEntry e = make_entry(0x80, 3, 1, false);
+  REQUIRE(e.matches(0x80, 7, 1, 3, 1));
+  REQUIRE(!e.matches(0x81, 7, 1, 3, 1));
+  REQUIRE(!e.matches(0x80, 8, 1, 3, 1));  // context
+  REQUIRE(!e.matches(0x80, 7, 0, 3, 1));  // mode
+  REQUIRE(!e.matches(0x80, 7, 1, 4, 1));  // ASID
+  REQUIRE(!e.matches(0x80, 7, 1, 3, 2));  // VMID
+
+  // global entries hit in every address space, but only in their VMID
+  e.global = true;
+  REQUIRE(e.matches(0x80, 7, 1, 4, 1));
+  REQUIRE(!e.matches(0x80, 7, 1, 4, 2));
+
+  e.valid = false;
+  REQUIRE(!e.matches(0x80, 7, 1, 3, 1));
+}
+
+TEST_CASE("ASID and VMID fences", "[soft_tlb]") {
+  SoftTlbEntry tlb[8] = {};
+  tlb[0] = make_entry(0, 1, 1, false);
+  tlb[1] = make_entry(1, 2, 1, false);
+  tlb[2] = make_entry(2, 1, 1, true);
+  tlb[3] = make_entry(3, 1, 2, false);
+
+  SoftTlbFence fence;
+  fence.single_vmid = true;
+  fence.vmid = 1;
+  fence.single_asid = true;
+  fence.asid = 1;
+  soft_tlb_fence(tlb, 8, fence);
+  REQUIRE(!tlb[0].valid);
+  REQUIRE(tlb[1].valid);  // other ASID
+  REQUIRE(tlb[2].valid);  // global
+  REQUIRE(tlb[3].valid);  // other VMID
+
+  fence.single_asid = false;
+  soft_tlb_fence(tlb, 8, fence);
+  REQUIRE(!tlb[1].valid);
+  REQUIRE(!tlb[2].valid);
+  REQUIRE(tlb[3].valid);
+}
+
+TEST_CASE("single page fences look at one slot", "[soft_tlb]") {
+  SoftTlbEntry tlb[8] = {};
+  tlb[5] = make_entry(0x15, 1, 0, true);
+  tlb[6] = make_entry(0x16, 1, 0, false);
+
+  SoftTlbFence fence;
+  fence.single_page = true;
+  fence.vpn = 0x1d;  // same slot, other page
+  soft_tlb_fence(tlb, 8, fence);
+  REQUIRE(tlb[5].valid);
+
+  // an address-only fence includes global entries
+  fence.vpn = 0x15;
+  soft_tlb_fence(tlb, 8, fence);
+  REQUIRE(!tlb[5].valid);
+  REQUIRE(tlb[6].valid);
+}
+
+TEST_CASE("superpages take one entry", "[soft_tlb]") {
+  SoftSuperpageTlb tlb;
+  REQUIRE(tlb.lookup(0x80200, 7, 1, 3, 0) == nullptr);
+
+  // 2 MiB page at 0x80200000 and 1 GiB page at 0x40000000
+  SoftTlbEntry mega = make_entry(0x80200, 3, 0, false);
+  mega.shift = 21;
+  tlb.fill(mega);
+  SoftTlbEntry giga = make_entry(0x40000, 3, 0, false);
+  giga.shift = 30;
+  tlb.fill(giga);
+
+  REQUIRE(tlb.lookup(0x80200, 7, 1, 3, 0) != nullptr);
+  REQUIRE(tlb.lookup(0x803ff, 7, 1, 3, 0)->vpn == 0x80200);
+  REQUIRE(tlb.lookup(0x80400, 7, 1, 3, 0) == nullptr);
+  REQUIRE(tlb.lookup(0x7ffff, 7, 1, 3, 0)->vpn == 0x40000);
+  REQUIRE(tlb.lookup(0x7ffff, 7, 1, 4, 0) == nullptr);
+
+  // a single page fence anywhere inside a superpage drops it
+  SoftTlbFence fence;
+  fence.single_page = true;
+  fence.vpn = 0x80321;
+  tlb.fence(fence);
+  REQUIRE(tlb.lookup(0x80200, 7, 1, 3, 0) == nullptr);
+  REQUIRE(tlb.lookup(0x40000, 7, 1, 3, 0) != nullptr);
+
+  tlb.invalidate();
+  REQUIRE(tlb.lookup(0x40000, 7, 1, 3, 0) == nullptr);
+}
@@ -0,0 +1,34 @@
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <udb/timing_model.hpp>
+
+using namespace udb;
+
+TEST_CASE("default costs", "[timing_model]") {
+  TimingModel t;
+  REQUIRE(t.cpi() == 1.0);
+  REQUIRE(TimingModel::to_cycles(t.cost(InstClass::Alu)) == 1);
+  REQUIRE(TimingModel::to_cycles(t.cost(InstClass::Div)) == 1 + t.latency(InstClass::Div));
+  REQUIRE(t.timebase_ratio() == 1);
+}
+
+TEST_CASE("fractional cpi accumulates", "[timing_model]") {
+  TimingModel t;
+  t.set_cpi(1.5);
+
+  uint64_t fx = 0;
+  for (unsigned i = 0; i < 10; i++) {
+    fx += t.cost(InstClass::Alu);
+  }
+  REQUIRE(TimingModel::to_cycles(fx) == 15);
+
+  t.set_latency(InstClass::Load, 3);
+  REQUIRE(t.cost(InstClass::Load) == t.cost(InstClass::Alu) + (3 << TimingModel::FRAC_BITS));
+}
+
+TEST_CASE("class names", "[timing_model]") {
+  REQUIRE(TimingModel::class_from_name("div") == InstClass::Div);
+  REQUIRE(TimingModel::class_from_name("system") == InstClass::System);
+  REQUIRE(!TimingModel::class_from_name("nope").has_value());
+}
@@ -6,6 +6,7 @@ require "sorbet-runtime"
 
 require_relative "constexpr_pass"
 require_relative "control_flow_pass"
+require_relative "pc_use_pass"
 require_relative "written_pass"
 require "idlc/type"
 
@@ -0,0 +1,50 @@
+# frozen_string_literal: true
+
+# pass to see if node may read or set the PC
+# raising an exception reads the PC, and builtin or generated functions may do anything
+
+module Idl
+  class AstNode
+    def uses_pc?(symtab)
+      if children.empty?
+        false
+      else
+        children.any? { |child| child.uses_pc?(symtab) }
+      end
+    end
+  end
+
+  class PcAssignmentAst
+    def uses_pc?(symtab) = true
+  end
+
+  class BuiltinVariableAst
+    def uses_pc?(symtab) = name == "$pc"
+  end
+
+  class FunctionCallExpressionAst
+    # results for function bodies, keyed by definition. The walk only looks at the
+    # body's syntax, so the result is the same for every call site and template value.
+    # A function still being walked (recursion) conservatively uses the PC.
+    @body_uses_pc = {}.compare_by_identity
+    class << self
+      attr_reader :body_uses_pc
+    end
+
+    def uses_pc?(symtab)
+      return true if children.any? { |child| child.uses_pc?(symtab) }
+
+      func_def_type = func_type(symtab)
+
+      return true if func_def_type.builtin? || func_def_type.generated?
+
+      cache = FunctionCallExpressionAst.body_uses_pc
+      func_def = func_def_type.func_def_ast
+      unless cache.key?(func_def)
+        cache[func_def] = :in_progress
+        cache[func_def] = func_def_type.body.uses_pc?(symtab)
+      end
+      cache[func_def] != false
+    end
+  end
+end
@@ -23,6 +23,54 @@ module Udb
       fmt
     end
 
+    # how the instruction jumps, for block chaining (a udb::JumpKind enumerator)
+    def jump_kind
+      case name
+      when "jal" then "Jal"
+      when "jalr" then "Jalr"
+      when "c.j" then "CJ"
+      when "c.jal" then "CJal"
+      when "c.jr" then "CJr"
+      when "c.jalr" then "CJalr"
+      when "cm.jt" then "CmJt"
+      when "cm.jalt" then "CmJalt"
+      else "None"
+      end
+    end
+
+    # broad class of the instruction, for the timing model (a udb::InstClass enumerator)
+    def timing_class
+      base = name.delete_prefix("c.")
+      case base
+      when /^(lb|lh|lw|ld|lq|lbu|lhu|lwu|lwsp|ldsp|lqsp|flh|flw|fld|flq|flwsp|fldsp)$/
+        "Load"
+      when /^(sb|sh|sw|sd|sq|swsp|sdsp|sqsp|fsh|fsw|fsd|fsq|fswsp|fsdsp)$/
+        "Store"
+      when /^(lr|sc|amo)/
+        "Atomic"
+      when /^mul/, /^clmul/
+        "Mul"
+      when /^(div|rem)/
+        "Div"
+      when /^(beq|bne|blt|bge|beqz|bnez)/
+        "Branch"
+      when /^(jal|jalr|j|jr|cm\.jt|cm\.jalt)$/
+        "Jump"
+      when /^csrr/
+        "Csr"
+      when /^(fence|ecall|ebreak|mret|sret|dret|wfi|sfence|hfence|sinval|cbo|wrs)/
+        "System"
+      when /^f(div|sqrt)/
+        "FpDiv"
+      when /^f/
+        "Fp"
+      when /^v/
+        "Vector"
+      else
+        "Alu"
+      end
+    end
+
     def assembly_fmt_args(xlen)
       args = []
       dvs = encoding(xlen).decode_variables
@@ -42,6 +90,31 @@ module Udb
       end
     end
   end
+
+  class Csr
+    # call made on the hart after software writes the CSR, so that state the hart keeps
+    # outside of the CSR follows it, or nil if there is none
+    def write_hook
+      case name
+      when /^mhpmcounter(\d+)(h?)$/
+        "_hpm_counter_written(#{::Regexp.last_match(1)}, #{::Regexp.last_match(2) == "h"}, value.get_ignore_unknown())"
+      when /^mhpmevent(\d+)$/
+        "_hpm_event_written(#{::Regexp.last_match(1)})"
+      when "mcountinhibit"
+        "_countinhibit_written()"
+      when "minstretcfg", "minstretcfgh"
+        "_instret_inhibit_written()"
+      when "jvt", /^pmpcfg\d+$/, /^pmpaddr\d+$/
+        "_jump_table_source_written()"
+      when "medeleg", "hedeleg", "mideleg", "hideleg", "mtvec", "stvec", "vstvec"
+        "_trap_routing_written()"
+      when "satp", "vsatp", "hgatp", "mstatus", "sstatus", "vsstatus", "hstatus", "menvcfg", "menvcfgh", "henvcfg"
+        "_translation_state_written()"
+      when "misa"
+        "_misa_written()"
+      end
+    end
+  end
 end
 
 module Udb
@@ -147,6 +220,25 @@ module CppHartGen
     end
   end
 
+  # Names of the non-constant static variables declared in generated C++ source.
+  #
+  # Every hart of a config in the process shares its statics, so anything that can
+  # change at runtime must be a member of the hart (or of something it owns) instead.
+  # Static functions and const/constexpr statics are fine.
+  sig { params(source: String).returns(T::Array[String]) }
+  def self.mutable_statics(source)
+    source.scan(/^\s*(?:inline\s+)?static\s+(?!(?:inline\s+)?(?:const|constexpr|constinit)\b)[^;{}()]*?\b(\w+)\s*(?:=[^;]*|\{[^;]*\})?;/).flatten
+  end
+
+  # raise if source, generated from template_path, declares a non-constant static
+  sig { params(source: String, template_path: T.any(String, Pathname)).void }
+  def self.check_no_mutable_statics!(source, template_path)
+    statics = mutable_statics(source)
+    return if statics.empty?
+
+    raise "#{template_path} generates mutable static(s) #{statics.join(", ")}; per-hart state must be a hart member"
+  end
+
   class TemplateEnv
     attr_reader :cfg_arch
     def initialize(cfg_arch)
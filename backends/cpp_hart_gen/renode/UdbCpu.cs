@@ -129,11 +129,8 @@ namespace Antmicro.Renode.Peripherals
                     // wfi
                     result = ExecutionResult.WaitingForInterrupt;
                 } else if (udb_result == 3) {
-                    // Pause
-                    this.Log(LogLevel.Warning, "TODO: Pause");
-                    InvokeHalted(new HaltArguments(HaltReason.Abort, this));
-                    return ExecutionResult.Aborted;
-//                    result = ExecutionResult.Pause;
+                    // Pause: the hart gave up the rest of its quantum
+                    result = ExecutionResult.Ok;
                 } else if (udb_result == 4) {
                     // Ebreak
                     result = ExecutionResult.StoppedAtBreakpoint;
@@ -6185,24 +6185,10 @@ module Idl
           end
           return v
 
-        elsif name == "cached_translation"
-          value_error "cached_translation is not compile-time-knowable"
-        elsif name == "maybe_cache_translation"
-          value_error "maybe_cache_translation is not compile-time-knowable"
-        elsif name == "invalidate_translations"
-          value_error "invalidate_translations is not compile-time-knowable"
-        elsif name == "direct_csr_lookup"
-          value_error "direct_csr_lookup is not compile-time-knowable"
-        elsif name == "indirect_csr_lookup"
-          value_error "indirect_csr_lookup is not compile-time-knowable"
-        elsif name == "csr_hw_read"
-          value_error "csr_hw_read is not compile-time-knowable"
-        elsif name == "csr_sw_read"
-          value_error "csr_sw_read is not compile-time-knowable"
-        elsif name == "csr_sw_write"
-          value_error "csr_sw_write is not compile-time-knowable"
         else
-          internal_error "Unimplemented generated: '#{name}'"
+          # every other generated function is implemented by the backend, and its
+          # value depends on hart state
+          value_error "#{name} is not compile-time-knowable"
         end
       end
       if func_def_type.builtin?